@@ -43,6 +43,7 @@ SOURCES += src/main.cpp \
 	src/AboutDialog.cpp \
 	src/joinpath.cpp \
 	src/misc.cpp \
+	src/pseudo_crypto.cpp \
 	src/SavePlaylistDialog.cpp \
 	src/TestConnectResultDialog.cpp \
 	src/pathcat.cpp \
@@ -80,7 +81,18 @@ SOURCES += src/main.cpp \
     src/SettingsDialog.cpp \
     src/AbstractSettingForm.cpp \
     src/SettingGeneralForm.cpp \
-    src/ApplicationGlobal.cpp
+    src/ApplicationGlobal.cpp \
+    src/LibraryStore.cpp \
+    src/LibrarySyncThread.cpp \
+    src/AlbumArtThread.cpp \
+    src/AlbumArtCache.cpp \
+    src/PlaylistResolver.cpp \
+    src/StreamProbe.cpp \
+    src/ImageKernels.cpp \
+    src/UpdateScheduler.cpp \
+    src/CommandMetrics.cpp \
+    src/DiagnosticDialog.cpp \
+    src/ProtocolTrace.cpp
 
 HEADERS  += src/MainWindow.h \
 	src/ColorSlider.h \
@@ -132,7 +144,19 @@ HEADERS  += src/MainWindow.h \
     src/SettingsDialog.h \
     src/AbstractSettingForm.h \
     src/SettingGeneralForm.h \
-    src/ApplicationGlobal.h
+    src/ApplicationGlobal.h \
+    src/LibraryStore.h \
+    src/LibrarySyncThread.h \
+    src/AlbumArtThread.h \
+    src/AlbumArtCache.h \
+    src/PlayerState.h \
+    src/PlaylistResolver.h \
+    src/StreamProbe.h \
+    src/ImageKernels.h \
+    src/UpdateScheduler.h \
+    src/CommandMetrics.h \
+    src/DiagnosticDialog.h \
+    src/ProtocolTrace.h
 
 FORMS    += src/MainWindow.ui \
 	src/VerticalVolumePopup.ui \
@@ -152,7 +176,8 @@ FORMS    += src/MainWindow.ui \
 	src/TinyConnectionDialog.ui \
 	src/AskRemoveOverlappedFileDialog.ui \
     src/SettingsDialog.ui \
-    src/SettingGeneralForm.ui
+    src/SettingGeneralForm.ui \
+    src/DiagnosticDialog.ui
 
 RESOURCES += \
 	resources.qrc
@@ -176,3 +201,15 @@ haiku {
 	LIBS += -lnetwork
 }
 
+# webclient.cpp の https 対応。OpenSSL を使わない場合は DEFINES += USE_OPENSSL=0
+!contains(DEFINES, USE_OPENSSL=0) {
+	unix:LIBS += -lssl -lcrypto
+	win32:LIBS += -llibssl -llibcrypto
+}
+
+# Content-Encoding: gzip/deflate の展開。使わない場合は DEFINES += USE_ZLIB=0
+!contains(DEFINES, USE_ZLIB=0) {
+	unix:LIBS += -lz
+	win32:LIBS += -lzlib
+}
+
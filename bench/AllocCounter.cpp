@@ -0,0 +1,35 @@
+#include "AllocCounter.h"
+
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+static std::atomic<quint64> allocations {0};
+
+quint64 allocationCount()
+{
+	return allocations;
+}
+
+void *operator new(size_t n)
+{
+	allocations++;
+	void *p = malloc(n ? n : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t n)
+{
+	return operator new(n);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
@@ -0,0 +1,9 @@
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+#include <QtGlobal>
+
+// operator new を置き換えて、これまでに確保した回数を数える。リンクしたプログラム全体に効く
+quint64 allocationCount();
+
+#endif // ALLOCCOUNTER_H
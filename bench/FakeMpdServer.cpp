@@ -0,0 +1,496 @@
+#include "FakeMpdServer.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSemaphore>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct Song {
+	QByteArray file;
+	QByteArray artist;
+	QByteArray album;
+	QByteArray title;
+	int track = 0;
+	int time = 0;
+};
+
+struct QueueEntry {
+	int song;
+	int id;
+};
+
+// 同じコマンドが何度も記録されていれば、記録された順に応答を返す。最後まで行ったら先頭に戻る
+struct ReplayEntry {
+	std::vector<QByteArray> responses;
+	size_t next = 0;
+};
+
+class Listener : public QTcpServer {
+public:
+	std::deque<qintptr> pending;
+protected:
+	void incomingConnection(qintptr fd) override
+	{
+		pending.push_back(fd);
+	}
+};
+
+// "add \"a b\" 3" を引数に分ける
+QList<QByteArray> split_args(QByteArray const &line)
+{
+	QList<QByteArray> args;
+	char const *p = line.constData();
+	char const *end = p + line.size();
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t')) p++;
+		if (p >= end) break;
+		QByteArray arg;
+		if (*p == '"') {
+			p++;
+			while (p < end && *p != '"') {
+				if (*p == '\\' && p + 1 < end) p++;
+				arg.append(*p++);
+			}
+			if (p < end) p++;
+		} else {
+			while (p < end && *p != ' ' && *p != '\t') {
+				arg.append(*p++);
+			}
+		}
+		args.push_back(arg);
+	}
+	return args;
+}
+
+}
+
+struct FakeMpdServer::Private {
+	Options opts;
+	std::vector<Song> songs;
+	QByteArray padding;
+	quint16 port = 0;
+	QSemaphore ready;
+	Counters counters;
+
+	QMutex mutex; // 以下はセッション間で共有
+	std::vector<QueueEntry> queue;
+	int next_id = 1;
+	std::atomic<unsigned int> version {1};
+	bool playing = true;
+	int volume = 50;
+	QElapsedTimer clock;
+	std::map<QByteArray, ReplayEntry> replay;
+	std::atomic<quint64> replay_misses {0};
+};
+
+class FakeMpdServer::Session : public QThread {
+private:
+	Private *pv;
+	qintptr fd;
+	QTcpSocket *sock = nullptr;
+
+	void send(QByteArray const &data)
+	{
+		sock->write(data);
+		while (sock->bytesToWrite() > 0 && sock->waitForBytesWritten(1000));
+		pv->counters.bytes_sent += data.size();
+	}
+
+	bool readLine(QByteArray *out)
+	{
+		while (!sock->canReadLine()) {
+			if (isInterruptionRequested() || sock->state() != QAbstractSocket::ConnectedState) {
+				return false;
+			}
+			sock->waitForReadyRead(100);
+		}
+		*out = sock->readLine();
+		pv->counters.bytes_received += out->size();
+		out->chop(out->endsWith('\n') ? 1 : 0);
+		return true;
+	}
+
+	void songBlock(int i, QByteArray *out)
+	{
+		Song const &s = pv->songs[i];
+		out->append("file: " + s.file + "\n");
+		out->append("Last-Modified: 2020-01-01T00:00:00Z\n");
+		out->append("Time: " + QByteArray::number(s.time) + "\n");
+		out->append("duration: " + QByteArray::number(s.time) + ".000\n");
+		out->append("Artist: " + s.artist + "\n");
+		out->append("Album: " + s.album + "\n");
+		out->append("Title: " + s.title + "\n");
+		out->append("Track: " + QByteArray::number(s.track) + "\n");
+		if (!pv->padding.isEmpty()) {
+			out->append("Comment: " + pv->padding + "\n");
+		}
+	}
+
+	// path 以下を列挙する。recursive でなければ直下のディレクトリとファイルだけ
+	void listTree(QByteArray const &path, bool recursive, bool info, QByteArray *out)
+	{
+		QByteArray prefix = path.isEmpty() ? QByteArray() : path + '/';
+		QByteArray lastdir;
+		for (int i = 0; i < (int)pv->songs.size(); i++) {
+			QByteArray const &file = pv->songs[i].file;
+			if (!file.startsWith(prefix)) continue;
+			int j = recursive ? file.lastIndexOf('/') : file.indexOf('/', prefix.size());
+			if (j > prefix.size()) {
+				QByteArray dir = file.left(j);
+				if (dir != lastdir) {
+					out->append("directory: " + dir + "\n");
+					lastdir = dir;
+				}
+				if (!recursive) continue;
+			}
+			if (info) {
+				songBlock(i, out);
+			} else {
+				out->append("file: " + file + "\n");
+			}
+		}
+	}
+
+	int findSong(QByteArray const &path)
+	{
+		for (int i = 0; i < (int)pv->songs.size(); i++) {
+			if (pv->songs[i].file == path) return i;
+		}
+		return -1;
+	}
+
+	void addSongs(QByteArray const &path, int pos, QByteArray *out)
+	{
+		std::vector<int> found;
+		int i = findSong(path);
+		if (i >= 0) {
+			found.push_back(i);
+		} else {
+			QByteArray prefix = path.isEmpty() ? QByteArray() : path + '/';
+			for (int j = 0; j < (int)pv->songs.size(); j++) {
+				if (pv->songs[j].file.startsWith(prefix)) found.push_back(j);
+			}
+		}
+		if (found.empty()) {
+			throw QByteArray("ACK [50@0] {add} No such directory");
+		}
+		QMutexLocker lock(&pv->mutex);
+		if (pos < 0 || pos > (int)pv->queue.size()) pos = (int)pv->queue.size();
+		for (int song : found) {
+			int id = pv->next_id++;
+			pv->queue.insert(pv->queue.begin() + pos++, QueueEntry{ song, id });
+			if (out) out->append("Id: " + QByteArray::number(id) + "\n");
+		}
+		pv->version++;
+	}
+
+	void execute(QByteArray const &line, QByteArray *out)
+	{
+		pv->counters.commands++;
+		QList<QByteArray> args = split_args(line);
+		QByteArray cmd = args.isEmpty() ? QByteArray() : args[0];
+		QByteArray arg1 = args.size() > 1 ? args[1] : QByteArray();
+		if (cmd == "ping" || cmd == "password") {
+		} else if (cmd == "status") {
+			QMutexLocker lock(&pv->mutex);
+			double elapsed = (pv->clock.elapsed() % 240000) / 1000.0;
+			out->append("volume: " + QByteArray::number(pv->volume) + "\n");
+			out->append("repeat: 0\nrandom: 0\nsingle: 0\nconsume: 0\n");
+			out->append("playlist: " + QByteArray::number((unsigned int)pv->version) + "\n");
+			out->append("playlistlength: " + QByteArray::number((int)pv->queue.size()) + "\n");
+			if (pv->queue.empty()) {
+				out->append("state: stop\n");
+			} else {
+				out->append(pv->playing ? "state: play\n" : "state: pause\n");
+				out->append("song: 0\nsongid: " + QByteArray::number(pv->queue[0].id) + "\n");
+				out->append("time: " + QByteArray::number((int)elapsed) + ":240\n");
+				out->append("elapsed: " + QByteArray::number(elapsed, 'f', 3) + "\n");
+			}
+		} else if (cmd == "currentsong") {
+			QMutexLocker lock(&pv->mutex);
+			if (!pv->queue.empty()) {
+				songBlock(pv->queue[0].song, out);
+				out->append("Pos: 0\nId: " + QByteArray::number(pv->queue[0].id) + "\n");
+			}
+		} else if (cmd == "lsinfo") {
+			listTree(arg1, false, true, out);
+		} else if (cmd == "listall") {
+			listTree(arg1, true, false, out);
+		} else if (cmd == "listallinfo") {
+			listTree(arg1, true, true, out);
+		} else if (cmd == "playlistinfo") {
+			QMutexLocker lock(&pv->mutex);
+			for (size_t i = 0; i < pv->queue.size(); i++) {
+				songBlock(pv->queue[i].song, out);
+				out->append("Pos: " + QByteArray::number((int)i) + "\nId: " + QByteArray::number(pv->queue[i].id) + "\n");
+			}
+		} else if (cmd == "add") {
+			addSongs(arg1, -1, nullptr);
+		} else if (cmd == "addid") {
+			addSongs(arg1, args.size() > 2 ? args[2].toInt() : -1, out);
+		} else if (cmd == "clear") {
+			QMutexLocker lock(&pv->mutex);
+			pv->queue.clear();
+			pv->version++;
+		} else if (cmd == "deleteid") {
+			QMutexLocker lock(&pv->mutex);
+			int id = arg1.toInt();
+			for (size_t i = 0; i < pv->queue.size(); i++) {
+				if (pv->queue[i].id == id) {
+					pv->queue.erase(pv->queue.begin() + i);
+					pv->version++;
+					break;
+				}
+			}
+		} else if (cmd == "setvol") {
+			QMutexLocker lock(&pv->mutex);
+			pv->volume = arg1.toInt();
+		} else if (cmd == "play" || cmd == "pause" || cmd == "stop") {
+			QMutexLocker lock(&pv->mutex);
+			pv->playing = (cmd == "play") || (cmd == "pause" && arg1 == "0");
+		} else {
+			throw QByteArray("ACK [5@0] {" + cmd + "} unknown command \"" + cmd + "\"");
+		}
+	}
+
+	bool replay(QByteArray const &command, QByteArray *out)
+	{
+		QMutexLocker lock(&pv->mutex);
+		if (pv->replay.empty()) return false;
+		auto it = pv->replay.find(command);
+		if (it == pv->replay.end()) {
+			pv->replay_misses++;
+			return false;
+		}
+		ReplayEntry &e = it->second;
+		*out = e.responses[e.next];
+		e.next = (e.next + 1) % e.responses.size();
+		return true;
+	}
+
+	// 何か変化するか noidle が届くまで待つ
+	void idle(QByteArray *out)
+	{
+		unsigned int v = pv->version;
+		while (!isInterruptionRequested() && sock->state() == QAbstractSocket::ConnectedState) {
+			if (pv->version != v) {
+				out->append("changed: playlist\n");
+				return;
+			}
+			if (sock->canReadLine() || sock->waitForReadyRead(10)) {
+				if (sock->canReadLine()) {
+					QByteArray line;
+					readLine(&line);
+					return; // noidle
+				}
+			}
+		}
+	}
+
+protected:
+	void run()
+	{
+		QTcpSocket socket;
+		if (!socket.setSocketDescriptor(fd)) return;
+		sock = &socket;
+		send("OK MPD 0.23.0\n");
+
+		std::vector<QByteArray> list;
+		bool in_list = false;
+		bool list_ok = false;
+		QByteArray line;
+		while (readLine(&line)) {
+			if (line == "close") break;
+			if (line == "noidle") continue; // idle 中でなければ応答しない
+			if (line == "command_list_begin" || line == "command_list_ok_begin") {
+				in_list = true;
+				list_ok = (line == "command_list_ok_begin");
+				list.clear();
+				continue;
+			}
+			if (in_list && line != "command_list_end") {
+				list.push_back(line);
+				continue;
+			}
+			QByteArray command = line;
+			if (in_list) {
+				command = list_ok ? "command_list_ok_begin\n" : "command_list_begin\n";
+				for (QByteArray const &l : list) {
+					command += l + '\n';
+				}
+				command += line;
+			} else {
+				list.assign(1, line);
+			}
+			in_list = false;
+
+			QByteArray out;
+			if (replay(command, &out)) {
+				pv->counters.commands += list.size();
+				list_ok = false;
+				if (pv->opts.latency > 0) {
+					QThread::msleep(pv->opts.latency);
+				}
+				send(out);
+				continue;
+			}
+			try {
+				for (size_t i = 0; i < list.size(); i++) {
+					QList<QByteArray> args = split_args(list[i]);
+					if (!args.isEmpty() && args[0] == "idle") {
+						idle(&out);
+					} else {
+						try {
+							execute(list[i], &out);
+						} catch (QByteArray const &ack) {
+							QByteArray a = ack;
+							a.replace("[5@0]", "[5@" + QByteArray::number((int)i) + "]");
+							a.replace("[50@0]", "[50@" + QByteArray::number((int)i) + "]");
+							throw a;
+						}
+					}
+					if (list_ok) out.append("list_OK\n");
+				}
+				out.append("OK\n");
+			} catch (QByteArray const &ack) {
+				out.append(ack + "\n");
+			}
+			list_ok = false;
+			if (pv->opts.latency > 0) {
+				QThread::msleep(pv->opts.latency);
+			}
+			send(out);
+		}
+		socket.close();
+	}
+public:
+	Session(FakeMpdServer *server, qintptr fd)
+		: pv(server->pv)
+		, fd(fd)
+	{
+	}
+};
+
+FakeMpdServer::FakeMpdServer(Options const &opts)
+{
+	pv = new Private();
+	pv->opts = opts;
+	pv->padding = QByteArray(opts.padding, 'x');
+	pv->clock.start();
+	pv->songs.resize(opts.songs);
+	for (int i = 0; i < opts.songs; i++) {
+		Song *s = &pv->songs[i];
+		int artist = i / 100;
+		int album = (i / 10) % 10;
+		s->track = i % 10 + 1;
+		s->time = 180 + i % 120;
+		if (opts.cjk) {
+			s->artist = QString("アーティスト %1").arg(artist, 4, 10, QChar('0')).toUtf8();
+			s->album = QString("アルバム %1").arg(album, 2, 10, QChar('0')).toUtf8();
+			s->title = QString("曲名 %1 春夏秋冬").arg(i, 7, 10, QChar('0')).toUtf8();
+		} else {
+			s->artist = "Artist " + QByteArray::number(artist).rightJustified(4, '0');
+			s->album = "Album " + QByteArray::number(album).rightJustified(2, '0');
+			s->title = "Title " + QByteArray::number(i).rightJustified(7, '0');
+		}
+		s->file = s->artist + '/' + s->album + '/' + QByteArray::number(s->track).rightJustified(2, '0') + " - " + s->title + ".flac";
+	}
+}
+
+FakeMpdServer::~FakeMpdServer()
+{
+	stop();
+	delete pv;
+}
+
+bool FakeMpdServer::listen(quint16 port)
+{
+	pv->port = port;
+	start();
+	pv->ready.acquire();
+	return pv->port != 0;
+}
+
+void FakeMpdServer::stop()
+{
+	requestInterruption();
+	wait();
+}
+
+quint16 FakeMpdServer::port() const
+{
+	return pv->port;
+}
+
+int FakeMpdServer::songCount() const
+{
+	return (int)pv->songs.size();
+}
+
+QString FakeMpdServer::songPath(int i) const
+{
+	return QString::fromUtf8(pv->songs[i].file);
+}
+
+FakeMpdServer::Counters &FakeMpdServer::counters()
+{
+	return pv->counters;
+}
+
+void FakeMpdServer::resetCounters()
+{
+	pv->counters.commands = 0;
+	pv->counters.bytes_sent = 0;
+	pv->counters.bytes_received = 0;
+}
+
+void FakeMpdServer::setReplay(QList<ProtocolTrace::Record> const &records)
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->replay.clear();
+	pv->replay_misses = 0;
+	for (ProtocolTrace::Record const &r : records) {
+		pv->replay[r.command].responses.push_back(r.response);
+	}
+}
+
+quint64 FakeMpdServer::replayMisses() const
+{
+	return pv->replay_misses;
+}
+
+void FakeMpdServer::run()
+{
+	Listener server;
+	if (!server.listen(QHostAddress::LocalHost, pv->port)) {
+		pv->port = 0;
+		pv->ready.release();
+		return;
+	}
+	pv->port = server.serverPort();
+	pv->ready.release();
+
+	std::vector<std::unique_ptr<Session>> sessions;
+	while (!isInterruptionRequested()) {
+		server.waitForNewConnection(100);
+		while (!server.pending.empty()) {
+			sessions.emplace_back(new Session(this, server.pending.front()));
+			server.pending.pop_front();
+			sessions.back()->start();
+		}
+	}
+	for (auto &s : sessions) {
+		s->requestInterruption();
+	}
+	for (auto &s : sessions) {
+		s->wait();
+	}
+}
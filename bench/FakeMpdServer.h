@@ -0,0 +1,45 @@
+#ifndef FAKEMPDSERVER_H
+#define FAKEMPDSERVER_H
+
+#include "ProtocolTrace.h"
+
+#include <QThread>
+#include <atomic>
+
+// ベンチマーク用の偽 MPD。N 曲の合成ライブラリを持ち、接続ごとにスレッドを立てて応答する。
+// idle/noidle と command_list にも対応する。
+// setReplay で記録を渡すと、記録にあるコマンドには記録したとおりの応答を返す。
+class FakeMpdServer : public QThread {
+public:
+	struct Options {
+		int songs = 10000;
+		int latency = 0; // 応答を返す前に待つ時間 (ms)
+		int padding = 0; // 曲ごとに付け足す Comment タグのバイト数
+		bool cjk = false; // タグとパスに日本語を使う
+	};
+	struct Counters {
+		std::atomic<quint64> commands {0};
+		std::atomic<quint64> bytes_sent {0};
+		std::atomic<quint64> bytes_received {0};
+	};
+private:
+	class Session;
+	struct Private;
+	Private *pv;
+protected:
+	void run();
+public:
+	FakeMpdServer(Options const &opts);
+	~FakeMpdServer();
+	bool listen(quint16 port = 0);
+	void stop();
+	quint16 port() const;
+	int songCount() const;
+	QString songPath(int i) const;
+	Counters &counters();
+	void resetCounters();
+	void setReplay(QList<ProtocolTrace::Record> const &records);
+	quint64 replayMisses() const;
+};
+
+#endif // FAKEMPDSERVER_H
@@ -0,0 +1,73 @@
+#ifndef PARSERHARNESS_H
+#define PARSERHARNESS_H
+
+#include "MusicPlayerClient.h"
+#include "PlaylistFile.h"
+#include "webclient.h"
+
+// ベンチマークとファジングから、各クラスの非公開の解析関数を直接呼ぶための窓口
+struct ParserHarness {
+	// MPD の応答を受け取る。dev にはソケットの代わりに QBuffer を渡せる
+	static bool mpdRecv(MusicPlayerClient *mpc, QIODevice *dev, QStringList *lines, QByteArray *binary = nullptr)
+	{
+		return mpc->recv(dev, lines, binary);
+	}
+	static void mpdParse(MusicPlayerClient *mpc, QStringList const &lines, QList<MusicPlayerClient::Item> *out)
+	{
+		mpc->parse_result(lines, out);
+	}
+	static void mpdParse(MusicPlayerClient *mpc, QStringList const &lines, MusicPlayerClient::StringMap *out)
+	{
+		mpc->parse_result(lines, out);
+	}
+
+	static bool parsePls(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
+	{
+		return PlaylistFile::parse_pls(begin, end, out);
+	}
+	static bool parseM3u(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out, QString const &base = QString())
+	{
+		return PlaylistFile::parse_m3u(begin, end, out, base);
+	}
+	static bool parseXspf(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
+	{
+		return PlaylistFile::parse_xspf(begin, end, out);
+	}
+	static bool parseAsx(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
+	{
+		return PlaylistFile::parse_asx(begin, end, out);
+	}
+	static bool parseJson(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
+	{
+		return PlaylistFile::parse_json(begin, end, out);
+	}
+	static PlaylistFile::Format sniff(std::string const &content_type, QString const &loc, char const *begin, char const *end)
+	{
+		return PlaylistFile::sniff(content_type, loc, begin, end);
+	}
+
+	// 受信したバイト列をヘッダとして解析する。ヘッダの終わりまでに使ったバイト数を返す。大きすぎると WebClient::Error を投げる
+	static size_t httpHeader(WebClient *wc, char const *ptr, size_t len)
+	{
+		wc->begin_response();
+		return wc->append_header(ptr, len, nullptr);
+	}
+	// read_response と同じように、届いた分から順にヘッダと本文に振り分ける。最初に httpBegin を呼ぶ
+	static void httpBegin(WebClient *wc)
+	{
+		wc->begin_response();
+	}
+	static void httpReceive(WebClient *wc, char const *ptr, size_t len, WebClientHandler *handler)
+	{
+		if (!wc->data.header_done) {
+			size_t n = wc->append_header(ptr, len, handler);
+			ptr += n;
+			len -= n;
+			if (!wc->data.header_done) return;
+		}
+		if (len > 0) {
+			wc->append_body(ptr, len, handler);
+		}
+	}};
+
+#endif // PARSERHARNESS_H
@@ -0,0 +1,30 @@
+# MusicPlayerClient のベンチマーク。偽 MPD サーバを内蔵する
+#   qmake bench.pro && make && ./mpdbench --songs 100000
+
+QT       += core network
+QT       -= gui
+
+TARGET = mpdbench
+TEMPLATE = app
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DESTDIR = $$PWD/../_bin
+
+unix:QMAKE_CXXFLAGS += -Wall -Wextra -Werror=return-type -Werror=trigraphs -Wno-switch
+
+INCLUDEPATH += $$PWD/../src
+
+SOURCES += main.cpp \
+    AllocCounter.cpp \
+    FakeMpdServer.cpp \
+    ../src/MusicPlayerClient.cpp \
+    ../src/CommandMetrics.cpp \
+    ../src/ProtocolTrace.cpp
+
+HEADERS += AllocCounter.h \
+    FakeMpdServer.h \
+    ../src/MusicPlayerClient.h \
+    ../src/CommandMetrics.h \
+    ../src/ProtocolTrace.h
@@ -0,0 +1,339 @@
+// MusicPlayerClient のベンチマーク。偽 MPD を立てて、接続・状態取得・ライブラリの解析・キュー操作の時間を測る。
+//
+//   mpdbench [--songs N] [--latency MS] [--padding BYTES] [--iterations N] [--cjk] [--csv]
+//   mpdbench --replay FILE [--latency MS] [--iterations N] [--csv]
+//
+// --replay は ProtocolTrace で記録したファイルを読み、偽 MPD に記録どおりの応答を返させて、同じコマンド列を送り直す。
+// idle / noidle は変化を待つだけなので送り直さない。albumart / readpicture は先頭のチャンクから
+// アプリと同じ関数で取り直し、続きのチャンクの要求はその中で送られる。
+
+#include "AllocCounter.h"
+#include "FakeMpdServer.h"
+#include "MusicPlayerClient.h"
+#include "ProtocolTrace.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+namespace {
+
+struct Result {
+	QString name;
+	int iterations = 0;
+	int items = 0; // 1 回あたりに扱った曲やコマンドの数
+	double total_ms = 0;
+	double p50_ms = 0;
+	double p99_ms = 0;
+	quint64 allocations = 0;
+	quint64 bytes = 0;
+};
+
+double percentile(std::vector<double> v, double p)
+{
+	if (v.empty()) return 0;
+	std::sort(v.begin(), v.end());
+	size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+	return v[std::min(i, v.size() - 1)];
+}
+
+// setup は計測の外で毎回呼ぶ。fn は扱った件数を返す
+Result measure(FakeMpdServer *server, QString const &name, int iterations, std::function<void()> setup, std::function<int()> fn)
+{
+	Result r;
+	r.name = name;
+	r.iterations = iterations;
+	std::vector<double> samples;
+	for (int i = 0; i < iterations; i++) {
+		if (setup) setup();
+		quint64 bytes0 = server->counters().bytes_sent + server->counters().bytes_received;
+		quint64 allocs0 = allocationCount();
+		QElapsedTimer t;
+		t.start();
+		r.items = fn();
+		double ms = t.nsecsElapsed() / 1000000.0;
+		r.allocations += allocationCount() - allocs0;
+		r.bytes += server->counters().bytes_sent + server->counters().bytes_received - bytes0;
+		samples.push_back(ms);
+		r.total_ms += ms;
+	}
+	r.p50_ms = percentile(samples, 0.50);
+	r.p99_ms = percentile(samples, 0.99);
+	return r;
+}
+
+void print(std::vector<Result> const &results, bool csv)
+{
+	if (csv) {
+		printf("name,iterations,items,p50_ms,p99_ms,ops_per_sec,mb_per_sec,allocs_per_op\n");
+	} else {
+		printf("%-24s %6s %8s %10s %10s %12s %10s %12s\n", "benchmark", "iter", "items", "p50(ms)", "p99(ms)", "ops/s", "MB/s", "allocs/op");
+	}
+	for (Result const &r : results) {
+		double secs = r.total_ms / 1000.0;
+		double ops = secs > 0 ? r.iterations / secs : 0;
+		double mbps = secs > 0 ? r.bytes / secs / (1024.0 * 1024.0) : 0;
+		double allocs = r.iterations > 0 ? (double)r.allocations / r.iterations : 0;
+		std::string name = r.name.toStdString();
+		if (csv) {
+			printf("%s,%d,%d,%.3f,%.3f,%.1f,%.2f,%.1f\n", name.c_str(), r.iterations, r.items, r.p50_ms, r.p99_ms, ops, mbps, allocs);
+		} else {
+			printf("%-24s %6d %8d %10.3f %10.3f %12.1f %10.2f %12.1f\n", name.c_str(), r.iterations, r.items, r.p50_ms, r.p99_ms, ops, mbps, allocs);
+		}
+	}
+}
+
+QString unquote(QString const &s)
+{
+	if (s.size() >= 2 && s.startsWith('"') && s.endsWith('"')) {
+		return s.mid(1, s.size() - 2);
+	}
+	return s;
+}
+
+// 記録したコマンドを、アプリと同じ解析を通るように対応する関数で送り直す
+bool replay_command(MusicPlayerClient *mpc, QByteArray const &command)
+{
+	QString cmd = QString::fromUtf8(command);
+	if (cmd.startsWith("command_list_begin\n")) {
+		QStringList lines = cmd.split('\n');
+		QStringList files;
+		for (int i = 1; i + 1 < lines.size(); i++) {
+			if (!lines[i].startsWith("add ")) {
+				files.clear();
+				break;
+			}
+			files.push_back(unquote(lines[i].mid(4)));
+		}
+		if (!files.isEmpty()) {
+			return mpc->do_add(files);
+		}
+	}
+	int i = cmd.indexOf(' ');
+	QString name = i < 0 ? cmd : cmd.left(i);
+	QString arg = i < 0 ? QString() : unquote(cmd.mid(i + 1));
+	if (name == "albumart" || name == "readpicture") { // albumart "PATH" OFFSET
+		int j = cmd.lastIndexOf(' ');
+		QByteArray image;
+		QString path = unquote(cmd.mid(i + 1, j - i - 1));
+		return name == "albumart" ? mpc->do_albumart(path, &image) : mpc->do_readpicture(path, &image);
+	}
+	MusicPlayerClient::StringMap map;
+	QList<MusicPlayerClient::Item> items;
+	if (name == "status") return mpc->do_status(&map);
+	if (name == "currentsong") return mpc->do_currentsong(&map);
+	if (name == "lsinfo") return mpc->do_lsinfo(arg, &items);
+	if (name == "listall") return mpc->do_listall(arg, &items);
+	if (name == "listallinfo") return mpc->do_listallinfo(arg, &items);
+	if (name == "playlistinfo") return mpc->do_playlistinfo(arg, &items);
+	if (name == "listplaylistinfo") return mpc->do_listplaylistinfo(arg, &items);
+	QStringList lines;
+	return mpc->do_command(cmd, &lines);
+}
+
+int replay(QString const &path, FakeMpdServer::Options const &opts, int iterations, bool csv)
+{
+	QList<ProtocolTrace::Record> records;
+	quint64 dropped = 0;
+	if (!ProtocolTrace::load(path, &records, &dropped)) {
+		fprintf(stderr, "failed to load trace: %s\n", path.toStdString().c_str());
+		return 1;
+	}
+	if (dropped > 0) {
+		fprintf(stderr, "warning: %llu records were dropped while recording\n", (unsigned long long)dropped);
+	}
+	std::stable_sort(records.begin(), records.end(), [](ProtocolTrace::Record const &l, ProtocolTrace::Record const &r){
+		return l.sent_ns < r.sent_ns;
+	});
+	// 偽 MPD には全部の応答を覚えさせるが、送り直すのは skipped() でないものだけ
+	auto skipped = [](QByteArray const &command){
+		if (command == "noidle" || command == "idle" || command.startsWith("idle ")) return true;
+		if (command.startsWith("albumart ") || command.startsWith("readpicture ")) { // 続きのチャンクは先頭から取り直すときに送られる
+			return !command.endsWith(" 0");
+		}
+		return false;
+	};
+	int skip_count = (int)std::count_if(records.begin(), records.end(), [&](ProtocolTrace::Record const &r){
+		return skipped(r.command);
+	});
+	if (skip_count > 0) {
+		fprintf(stderr, "note: %d idle/noidle and picture chunk records are not sent directly\n", skip_count);
+	}
+
+	FakeMpdServer::Options o = opts;
+	o.songs = 0;
+	FakeMpdServer server(o);
+	server.setReplay(records);
+	if (!server.listen()) {
+		fprintf(stderr, "failed to listen\n");
+		return 1;
+	}
+	Host host("127.0.0.1", server.port());
+
+	// 記録したときと同じように接続ごとにクライアントを分ける
+	std::map<quint64, std::unique_ptr<MusicPlayerClient>> clients;
+	for (ProtocolTrace::Record const &r : records) {
+		std::unique_ptr<MusicPlayerClient> &c = clients[r.connection];
+		if (!c) {
+			c.reset(new MusicPlayerClient());
+			if (!c->open(host)) {
+				fprintf(stderr, "failed to connect\n");
+				return 1;
+			}
+		}
+	}
+
+	CommandMetrics::reset();
+	std::vector<Result> results;
+	results.push_back(measure(&server, "replay " + QFileInfo(path).fileName(), iterations, nullptr, [&](){
+		for (ProtocolTrace::Record const &r : records) {
+			if (skipped(r.command)) continue;
+			replay_command(clients[r.connection].get(), r.command);
+		}
+		return (int)records.size() - skip_count;
+	}));
+	for (auto &pair : clients) {
+		pair.second->close();
+	}
+	server.stop();
+
+	print(results, csv);
+	if (server.replayMisses() > 0) {
+		fprintf(stderr, "warning: %llu commands were not found in the trace\n", (unsigned long long)server.replayMisses());
+	}
+	printf("\n%s", CommandMetrics::toCsv(CommandMetrics::snapshot()).constData());
+	return 0;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+
+	FakeMpdServer::Options opts;
+	int iterations = 20;
+	bool csv = false;
+	QString replay_path;
+	QStringList args = app.arguments();
+	for (int i = 1; i < args.size(); i++) {
+		QString const &a = args[i];
+		auto next = [&](){ return i + 1 < args.size() ? args[++i].toInt() : 0; };
+		if (a == "--songs") {
+			opts.songs = next();
+		} else if (a == "--latency") {
+			opts.latency = next();
+		} else if (a == "--padding") {
+			opts.padding = next();
+		} else if (a == "--iterations") {
+			iterations = std::max(1, next());
+		} else if (a == "--cjk") {
+			opts.cjk = true;
+		} else if (a == "--csv") {
+			csv = true;
+		} else if (a == "--replay" && i + 1 < args.size()) {
+			replay_path = args[++i];
+		} else {
+			fprintf(stderr, "usage: mpdbench [--songs N] [--latency MS] [--padding BYTES] [--iterations N] [--cjk] [--csv]\n");
+			fprintf(stderr, "       mpdbench --replay FILE [--latency MS] [--iterations N] [--csv]\n");
+			return 2;
+		}
+	}
+
+	if (!replay_path.isEmpty()) {
+		return replay(replay_path, opts, iterations, csv);
+	}
+
+	FakeMpdServer server(opts);
+	if (!server.listen()) {
+		fprintf(stderr, "failed to listen\n");
+		return 1;
+	}
+	Host host("127.0.0.1", server.port());
+
+	int batch = std::min(1000, server.songCount());
+	QStringList files;
+	for (int i = 0; i < batch; i++) {
+		files.push_back(server.songPath(i));
+	}
+
+	std::vector<Result> results;
+	MusicPlayerClient mpc;
+
+	results.push_back(measure(&server, "connect", iterations, nullptr, [&](){
+		MusicPlayerClient c;
+		c.open(host);
+		c.close();
+		return 1;
+	}));
+
+	if (!mpc.open(host)) {
+		fprintf(stderr, "failed to connect\n");
+		return 1;
+	}
+	mpc.do_clear();
+	mpc.do_add(files);
+
+	results.push_back(measure(&server, "status+currentsong", iterations * 10, nullptr, [&](){
+		MusicPlayerClient::StringMap status;
+		MusicPlayerClient::StringMap song;
+		mpc.do_status(&status);
+		mpc.do_currentsong(&song);
+		return 2;
+	}));
+
+	results.push_back(measure(&server, "lsinfo /", iterations, nullptr, [&](){
+		QList<MusicPlayerClient::Item> items;
+		mpc.do_lsinfo(QString(), &items);
+		return items.size();
+	}));
+
+	results.push_back(measure(&server, "listallinfo /", iterations, nullptr, [&](){
+		QList<MusicPlayerClient::Item> items;
+		mpc.do_listallinfo(QString(), &items);
+		return items.size();
+	}));
+
+	results.push_back(measure(&server, "add x1 (per command)", iterations, [&](){ mpc.do_clear(); }, [&](){
+		for (QString const &file : files) {
+			mpc.do_add(file);
+		}
+		return files.size();
+	}));
+
+	results.push_back(measure(&server, "add x1 (command_list)", iterations, [&](){ mpc.do_clear(); }, [&](){
+		mpc.do_add(files);
+		return files.size();
+	}));
+
+	results.push_back(measure(&server, "playlistinfo (sync)", iterations, nullptr, [&](){
+		QList<MusicPlayerClient::Item> items;
+		mpc.do_playlistinfo(QString(), &items);
+		return items.size();
+	}));
+
+	// 別の接続が idle で待っているところにキューを変更し、通知が届くまでの時間
+	MusicPlayerClient watcher;
+	if (watcher.open(host)) {
+		results.push_back(measure(&server, "idle wakeup", iterations, [&](){ watcher.do_idle("playlist"); }, [&](){
+			mpc.do_add(files.front());
+			QStringList changed;
+			watcher.wait_idle(10000, &changed);
+			return changed.size();
+		}));
+		watcher.close();
+	}
+
+	mpc.close();
+	server.stop();
+
+	print(results, csv);
+	return 0;
+}
@@ -0,0 +1,320 @@
+// 解析処理のマイクロベンチマーク。ネットワークを使わず、生成したコーパスを直接解析関数に渡して測る。
+//
+//   parserbench [--max-lines N] [--iterations N] [--filter TEXT] [--csv]
+//
+// コーパスは 1k / 10k / 100k / 1M 行で、タグが ASCII のものと日本語のものを用意する。
+// 結果は MB/s と 1 件あたりのメモリ確保回数で出す。--csv は CI で記録して比較するための形式。
+
+#include "AllocCounter.h"
+#include "ApplicationGlobal.h"
+#include "ParserHarness.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+#include <vector>
+
+ApplicationGlobal *global = nullptr;
+
+namespace {
+
+struct Corpus {
+	QByteArray data;
+	int lines = 0;
+	int items = 0;
+};
+
+struct Tags {
+	QByteArray artist;
+	QByteArray album;
+	QByteArray title;
+};
+
+Tags make_tags(int i, bool cjk)
+{
+	Tags t;
+	if (cjk) {
+		t.artist = QString("アーティスト %1").arg(i / 100, 4, 10, QChar('0')).toUtf8();
+		t.album = QString("アルバム %1").arg((i / 10) % 10, 2, 10, QChar('0')).toUtf8();
+		t.title = QString("曲名 %1 春夏秋冬").arg(i, 7, 10, QChar('0')).toUtf8();
+	} else {
+		t.artist = "Artist " + QByteArray::number(i / 100).rightJustified(4, '0');
+		t.album = "Album " + QByteArray::number((i / 10) % 10).rightJustified(2, '0');
+		t.title = "Title " + QByteArray::number(i).rightJustified(7, '0');
+	}
+	return t;
+}
+
+// listallinfo の応答。1 曲 9 行
+Corpus mpd_corpus(int lines, bool cjk)
+{
+	Corpus c;
+	while (c.lines + 9 < lines) {
+		int i = c.items++;
+		Tags t = make_tags(i, cjk);
+		QByteArray &d = c.data;
+		d += "file: " + t.artist + '/' + t.album + '/' + QByteArray::number(i % 10 + 1).rightJustified(2, '0') + " - " + t.title + ".flac\n";
+		d += "Last-Modified: 2020-01-01T00:00:00Z\n";
+		d += "Time: " + QByteArray::number(180 + i % 120) + "\n";
+		d += "duration: " + QByteArray::number(180 + i % 120) + ".000\n";
+		d += "Artist: " + t.artist + "\n";
+		d += "Album: " + t.album + "\n";
+		d += "Title: " + t.title + "\n";
+		d += "Track: " + QByteArray::number(i % 10 + 1) + "\n";
+		d += "Genre: Classical\n";
+		c.lines += 9;
+	}
+	c.data += "OK\n";
+	c.lines++;
+	return c;
+}
+
+Corpus pls_corpus(int lines, bool cjk)
+{
+	Corpus c;
+	c.data = "[playlist]\n";
+	c.lines = 1;
+	while (c.lines + 3 < lines) {
+		int i = c.items++;
+		Tags t = make_tags(i, cjk);
+		QByteArray n = QByteArray::number(i + 1);
+		c.data += "File" + n + "=http://radio.example.com:8000/stream" + QByteArray::number(i) + ".mp3\n";
+		c.data += "Title" + n + "=" + t.artist + " - " + t.title + "\n";
+		c.data += "Length" + n + "=-1\n";
+		c.lines += 3;
+	}
+	c.data += "NumberOfEntries=" + QByteArray::number(c.items) + "\nVersion=2\n";
+	c.lines += 2;
+	return c;
+}
+
+Corpus m3u_corpus(int lines, bool cjk)
+{
+	Corpus c;
+	c.data = "#EXTM3U\n";
+	c.lines = 1;
+	while (c.lines + 2 <= lines) {
+		int i = c.items++;
+		Tags t = make_tags(i, cjk);
+		c.data += "#EXTINF:" + QByteArray::number(180 + i % 120) + "," + t.artist + " - " + t.title + "\n";
+		c.data += "http://radio.example.com:8000/stream" + QByteArray::number(i) + ".mp3\n";
+		c.lines += 2;
+	}
+	return c;
+}
+
+Corpus xspf_corpus(int lines, bool cjk)
+{
+	Corpus c;
+	c.data = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n<title>Benchmark</title>\n<trackList>\n";
+	c.lines = 4;
+	while (c.lines + 4 + 2 <= lines) {
+		int i = c.items++;
+		Tags t = make_tags(i, cjk);
+		c.data += "<track>\n";
+		c.data += "<location>http://radio.example.com:8000/stream" + QByteArray::number(i) + ".mp3</location>\n";
+		c.data += "<title>" + t.artist + " - " + t.title + "</title>\n";
+		c.data += "</track>\n";
+		c.lines += 4;
+	}
+	c.data += "</trackList>\n</playlist>\n";
+	c.lines += 2;
+	return c;
+}
+
+// 16 行のレスポンスヘッダを並べたもの。1 件ずつ解析する
+Corpus http_corpus(int lines, bool cjk)
+{
+	Corpus c;
+	while (c.lines + 16 <= lines) {
+		int i = c.items++;
+		Tags t = make_tags(i, cjk);
+		QByteArray &d = c.data;
+		d += "HTTP/1.1 200 OK\r\n";
+		d += "Date: Mon, 01 Jan 2024 00:00:00 GMT\r\n";
+		d += "Server: Icecast 2.4.4\r\n";
+		d += "Content-Type: audio/mpeg\r\n";
+		d += "Cache-Control: no-cache, no-store\r\n";
+		d += "Expires: Mon, 26 Jul 1997 05:00:00 GMT\r\n";
+		d += "Pragma: no-cache\r\n";
+		d += "Connection: keep-alive\r\n";
+		d += "Access-Control-Allow-Origin: *\r\n";
+		d += "icy-br: 128\r\n";
+		d += "icy-genre: Classical\r\n";
+		d += "icy-name: " + t.artist + "\r\n";
+		d += "icy-description: " + t.album + " / " + t.title + "\r\n";
+		d += "icy-pub: 1\r\n";
+		d += "icy-url: http://radio.example.com/\r\n";
+		d += "\r\n";
+		c.lines += 16;
+	}
+	return c;
+}
+
+struct Result {
+	std::string parser;
+	std::string charset;
+	int lines = 0;
+	int bytes = 0;
+	int items = 0;
+	int iterations = 0;
+	double median_ms = 0;
+	quint64 allocations = 0;
+};
+
+// 指定がなければ 3 回以上、合計 0.3 秒以上になるまで繰り返して中央値をとる
+Result measure(char const *name, Corpus const &corpus, int iterations, std::function<int()> fn)
+{
+	Result r;
+	r.parser = name;
+	r.lines = corpus.lines;
+	r.bytes = corpus.data.size();
+	r.items = corpus.items;
+	std::vector<double> samples;
+	double total = 0;
+	while (iterations > 0 ? (int)samples.size() < iterations : (samples.size() < 3 || total < 300)) {
+		quint64 allocs0 = allocationCount();
+		QElapsedTimer t;
+		t.start();
+		int n = fn();
+		double ms = t.nsecsElapsed() / 1000000.0;
+		r.allocations += allocationCount() - allocs0;
+		if (n != corpus.items) {
+			fprintf(stderr, "warning: %s parsed %d items, expected %d\n", r.parser.c_str(), n, corpus.items);
+		}
+		samples.push_back(ms);
+		total += ms;
+	}
+	std::sort(samples.begin(), samples.end());
+	r.iterations = (int)samples.size();
+	r.median_ms = samples[samples.size() / 2];
+	return r;
+}
+
+void print_header(bool csv)
+{
+	if (csv) {
+		printf("parser,charset,lines,bytes,items,iterations,median_ms,mb_per_sec,items_per_sec,allocs_per_item\n");
+	} else {
+		printf("%-18s %-6s %8s %11s %8s %5s %11s %9s %13s %12s\n", "parser", "tags", "lines", "bytes", "items", "iter", "median(ms)", "MB/s", "items/s", "allocs/item");
+	}
+}
+
+// 大きなコーパスは時間がかかるので、測り終えたものから出していく
+void print(Result const &r, bool csv)
+{
+	double secs = r.median_ms / 1000.0;
+	double mbps = secs > 0 ? r.bytes / secs / (1024.0 * 1024.0) : 0;
+	double ips = secs > 0 ? r.items / secs : 0;
+	double allocs = r.items > 0 && r.iterations > 0 ? (double)r.allocations / r.iterations / r.items : 0;
+	if (csv) {
+		printf("%s,%s,%d,%d,%d,%d,%.3f,%.2f,%.0f,%.2f\n", r.parser.c_str(), r.charset.c_str(), r.lines, r.bytes, r.items, r.iterations, r.median_ms, mbps, ips, allocs);
+	} else {
+		printf("%-18s %-6s %8d %11d %8d %5d %11.3f %9.2f %13.0f %12.2f\n", r.parser.c_str(), r.charset.c_str(), r.lines, r.bytes, r.items, r.iterations, r.median_ms, mbps, ips, allocs);
+	}
+	fflush(stdout);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+
+	int max_lines = 1000000;
+	int iterations = 0;
+	bool csv = false;
+	QString filter;
+	QStringList args = app.arguments();
+	for (int i = 1; i < args.size(); i++) {
+		QString const &a = args[i];
+		if (a == "--max-lines" && i + 1 < args.size()) {
+			max_lines = args[++i].toInt();
+		} else if (a == "--iterations" && i + 1 < args.size()) {
+			iterations = std::max(1, args[++i].toInt());
+		} else if (a == "--filter" && i + 1 < args.size()) {
+			filter = args[++i];
+		} else if (a == "--csv") {
+			csv = true;
+		} else {
+			fprintf(stderr, "usage: parserbench [--max-lines N] [--iterations N] [--filter TEXT] [--csv]\n");
+			return 2;
+		}
+	}
+
+	struct Bench {
+		char const *name;
+		std::function<Corpus (int lines, bool cjk)> generate;
+		std::function<int (Corpus const &corpus)> run;
+	};
+
+	MusicPlayerClient mpc;
+	WebClient wc(nullptr);
+
+	std::vector<Bench> benches;
+	benches.push_back({"mpd.recv", mpd_corpus, [&](Corpus const &c){
+		QBuffer buf;
+		buf.setData(c.data);
+		buf.open(QBuffer::ReadOnly);
+		QStringList lines;
+		ParserHarness::mpdRecv(&mpc, &buf, &lines);
+		return lines.size() / 9;
+	}});
+	benches.push_back({"mpd.parse_result", mpd_corpus, nullptr});
+	benches.push_back({"pls", pls_corpus, [](Corpus const &c){
+		std::vector<PlaylistFile::Item> items;
+		ParserHarness::parsePls(c.data.constData(), c.data.constData() + c.data.size(), &items);
+		return (int)items.size();
+	}});
+	benches.push_back({"m3u", m3u_corpus, [](Corpus const &c){
+		std::vector<PlaylistFile::Item> items;
+		ParserHarness::parseM3u(c.data.constData(), c.data.constData() + c.data.size(), &items);
+		return (int)items.size();
+	}});
+	benches.push_back({"xspf", xspf_corpus, [](Corpus const &c){
+		std::vector<PlaylistFile::Item> items;
+		ParserHarness::parseXspf(c.data.constData(), c.data.constData() + c.data.size(), &items);
+		return (int)items.size();
+	}});
+	benches.push_back({"http.header", http_corpus, [&](Corpus const &c){
+		char const *p = c.data.constData();
+		char const *end = p + c.data.size();
+		int n = 0;
+		while (p < end) {
+			p += ParserHarness::httpHeader(&wc, p, end - p);
+			n++;
+		}
+		return n;
+	}});
+
+	print_header(csv);
+	for (int lines = 1000; lines <= max_lines; lines *= 10) {
+		for (int cjk = 0; cjk < 2; cjk++) {
+			for (Bench const &b : benches) {
+				if (!filter.isEmpty() && !QString(b.name).contains(filter)) continue;
+				Corpus corpus = b.generate(lines, cjk);
+				std::function<int()> fn;
+				QStringList split;
+				if (b.run) {
+					fn = [&](){ return b.run(corpus); };
+				} else { // 行に分けるところは測らない
+					split = QString::fromUtf8(corpus.data).split('\n', QString::SkipEmptyParts);
+					split.removeLast(); // OK
+					fn = [&](){
+						QList<MusicPlayerClient::Item> items;
+						ParserHarness::mpdParse(&mpc, split, &items);
+						return items.size();
+					};
+				}
+				Result r = measure(b.name, corpus, iterations, fn);
+				r.charset = cjk ? "cjk" : "ascii";
+				print(r, csv);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,49 @@
+# 解析処理のマイクロベンチマーク。生成したコーパスで MPD の応答、プレイリスト、HTTP ヘッダの解析を測る
+#   qmake parserbench.pro && make && ./parserbench --csv > result.csv
+
+QT       += core network
+QT       -= gui
+
+TARGET = parserbench
+TEMPLATE = app
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DESTDIR = $$PWD/../../_bin
+
+unix:QMAKE_CXXFLAGS += -Wall -Wextra -Werror=return-type -Werror=trigraphs -Wno-switch
+
+INCLUDEPATH += $$PWD/.. $$PWD/../../src
+
+SOURCES += main.cpp \
+    ../AllocCounter.cpp \
+    ../../src/MusicPlayerClient.cpp \
+    ../../src/CommandMetrics.cpp \
+    ../../src/ProtocolTrace.cpp \
+    ../../src/PlaylistFile.cpp \
+    ../../src/StreamProbe.cpp \
+    ../../src/MemoryReader.cpp \
+    ../../src/pathcat.cpp \
+    ../../src/webclient.cpp
+
+HEADERS += ../AllocCounter.h \
+    ../ParserHarness.h \
+    ../../src/MusicPlayerClient.h \
+    ../../src/CommandMetrics.h \
+    ../../src/ProtocolTrace.h \
+    ../../src/PlaylistFile.h \
+    ../../src/StreamProbe.h \
+    ../../src/MemoryReader.h \
+    ../../src/pathcat.h \
+    ../../src/webclient.h
+
+# webclient.cpp と同じ設定にする
+!contains(DEFINES, USE_OPENSSL=0) {
+	unix:LIBS += -lssl -lcrypto
+	win32:LIBS += -llibssl -llibcrypto
+}
+!contains(DEFINES, USE_ZLIB=0) {
+	unix:LIBS += -lz
+	win32:LIBS += -lzlib
+}
@@ -0,0 +1,52 @@
+# GUI なしで MPD を操作するコマンドラインクライアント。スクリプトからの操作や負荷試験に使う
+#   qmake cli.pro && make && ./skympc-cli status
+
+QT       += core network
+QT       -= gui
+
+TARGET = skympc-cli
+TEMPLATE = app
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DESTDIR = $$PWD/../_bin
+
+unix:QMAKE_CXXFLAGS += -Wall -Wextra -Werror=return-type -Werror=trigraphs -Wno-switch
+
+INCLUDEPATH += $$PWD/../src
+
+SOURCES += main.cpp \
+    ../src/MusicPlayerClient.cpp \
+    ../src/CommandMetrics.cpp \
+    ../src/ProtocolTrace.cpp \
+    ../src/PlaylistFile.cpp \
+    ../src/StreamProbe.cpp \
+    ../src/MemoryReader.cpp \
+    ../src/Server.cpp \
+    ../src/MySettings.cpp \
+    ../src/pseudo_crypto.cpp \
+    ../src/pathcat.cpp \
+    ../src/webclient.cpp
+
+HEADERS += ../src/MusicPlayerClient.h \
+    ../src/CommandMetrics.h \
+    ../src/ProtocolTrace.h \
+    ../src/PlaylistFile.h \
+    ../src/StreamProbe.h \
+    ../src/MemoryReader.h \
+    ../src/Server.h \
+    ../src/MySettings.h \
+    ../src/misc.h \
+    ../src/pathcat.h \
+    ../src/webclient.h
+
+# webclient.cpp と同じ設定にする
+!contains(DEFINES, USE_OPENSSL=0) {
+	unix:LIBS += -lssl -lcrypto
+	win32:LIBS += -llibssl -llibcrypto
+}
+!contains(DEFINES, USE_ZLIB=0) {
+	unix:LIBS += -lz
+	win32:LIBS += -lzlib
+}
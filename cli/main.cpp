@@ -0,0 +1,546 @@
+// SkyMPC のコマンドライン版。GUI と同じ MusicPlayerClient と、登録済みのサーバの設定を使う。
+//
+//   skympc-cli [-s NAME | -H HOST[:PORT]] [-P PASSWORD] [--json] COMMAND [ARGS...]
+//
+//   servers                         登録済みのサーバの一覧
+//   status                          再生状態と再生中の曲
+//   play [POS] | pause | stop | next | prev | setvol N
+//   queue                           キューの一覧
+//   add [--no-resolve] ITEM...      キューの末尾に追加する。"-" なら標準入力から 1 行に 1 件ずつ読む
+//   insert POS ITEM...              POS の位置に追加する
+//   delete ID...                    キューから消す。ID は queue で表示されるもの
+//   clear                           キューを空にする
+//   dump [PATH]                     ライブラリを JSON で書き出す
+//   idle [SUBSYSTEM...]             変化があるたびに JSON を 1 行ずつ書き出し続ける
+//   load [-c N] [-t SEC] [-r OPS] [COMMAND...]
+//                                   N 本の接続からコマンドを繰り返し送り、コマンドごとの統計を出す
+//   raw COMMAND                     コマンドをそのまま送って応答を表示する
+//
+// サーバは -s（登録名）、-H、環境変数 MPD_HOST / MPD_PORT、登録済みの最初のサーバ、localhost の順に決める。
+// 追加するものが http のプレイリスト (.pls/.m3u/.xspf など) なら、GUI と同じく中身の URL に展開する。
+
+#include "ApplicationGlobal.h"
+#include "CommandMetrics.h"
+#include "MySettings.h"
+#include "PlaylistFile.h"
+#include "Server.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+ApplicationGlobal *global;
+
+namespace {
+
+int const EXIT_USAGE = 2;
+
+struct Options {
+	bool json = false;
+};
+
+void usage()
+{
+	fprintf(stderr,
+		"usage: skympc-cli [-s NAME | -H HOST[:PORT]] [-P PASSWORD] [--json] COMMAND [ARGS...]\n"
+		"\n"
+		"  servers                     list registered servers\n"
+		"  status                      playback status and current song\n"
+		"  play [POS] | pause | stop | next | prev | setvol N\n"
+		"  queue                       list the play queue\n"
+		"  add [--no-resolve] ITEM...  append to the queue ('-' reads one item per line from stdin)\n"
+		"  insert POS ITEM...          insert at POS\n"
+		"  delete ID...                remove songs by queue id\n"
+		"  clear                       clear the queue\n"
+		"  dump [PATH]                 write the library as JSON\n"
+		"  idle [SUBSYSTEM...]         write one JSON line per change until interrupted\n"
+		"  load [-c N] [-t SEC] [-r OPS] [COMMAND...]\n"
+		"                              repeat commands over N connections and report per-command stats\n"
+		"  raw COMMAND                 send a command as is and print the response\n");
+}
+
+void print_line(QString const &s)
+{
+	QByteArray ba = s.toUtf8();
+	ba.append('\n');
+	fwrite(ba.data(), 1, ba.size(), stdout);
+}
+
+void print_json(QJsonValue const &v, bool compact = false)
+{
+	QJsonDocument doc = v.isArray() ? QJsonDocument(v.toArray()) : QJsonDocument(v.toObject());
+	QByteArray ba = doc.toJson(compact ? QJsonDocument::Compact : QJsonDocument::Indented);
+	if (!ba.endsWith('\n')) ba.append('\n');
+	fwrite(ba.data(), 1, ba.size(), stdout);
+	fflush(stdout);
+}
+
+QJsonObject to_json(MusicPlayerClient::StringMap const &map)
+{
+	QJsonObject obj;
+	for (auto const &pair : map.map) {
+		obj[pair.first] = pair.second;
+	}
+	return obj;
+}
+
+QJsonObject to_json(MusicPlayerClient::Item const &item)
+{
+	QJsonObject obj = to_json(item.map);
+	obj[item.kind] = item.text;
+	return obj;
+}
+
+int fail(MusicPlayerClient const &mpc)
+{
+	QString msg = mpc.message();
+	fprintf(stderr, "skympc-cli: %s\n", msg.isEmpty() ? "command failed" : msg.toUtf8().constData());
+	return 1;
+}
+
+Host resolve_host(QString const &name, QString const &address, QString const &password, bool *ok)
+{
+	*ok = true;
+	std::vector<ServerItem> servers;
+	loadPresetServers(&servers);
+	Host host;
+	if (!name.isEmpty()) {
+		bool found = false; // ポートを省いたプリセットは port 0 で保存されているので、isValid() では判断できない
+		for (ServerItem const &s : servers) {
+			if (s.name.compare(name, Qt::CaseInsensitive) == 0) {
+				host = s.host;
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "skympc-cli: no such server: %s\n", name.toUtf8().constData());
+			*ok = false;
+			return host;
+		}
+	} else if (!address.isEmpty()) {
+		host = Host(address);
+	} else if (!qgetenv("MPD_HOST").isEmpty()) { // mpc と同じく password@host の形も受け付ける
+		QString s = QString::fromLocal8Bit(qgetenv("MPD_HOST"));
+		int i = s.lastIndexOf('@');
+		host = Host(s.mid(i + 1), qgetenv("MPD_PORT").toInt());
+		if (i > 0) {
+			host.setPassword(s.left(i));
+		}
+	} else if (!servers.empty()) {
+		host = servers.front().host;
+	} else {
+		host = Host("localhost");
+	}
+	if (host.port() == 0) {
+		host.setPort(DEFAULT_MPD_PORT);
+	}
+	if (!password.isEmpty()) {
+		host.setPassword(password);
+	}
+	return host;
+}
+
+// http のプレイリストなら中身に展開する。音声ストリームや解析できないものはそのまま追加する
+QStringList expand_items(QStringList const &args, bool resolve)
+{
+	QStringList items;
+	for (QString const &arg : args) {
+		if (arg == "-") {
+			QTextStream in(stdin);
+			in.setCodec("UTF-8");
+			while (!in.atEnd()) {
+				QString line = in.readLine().trimmed();
+				if (!line.isEmpty()) items.push_back(line);
+			}
+			continue;
+		}
+		if (resolve && (arg.startsWith("http://") || arg.startsWith("https://"))) {
+			std::vector<PlaylistFile::Item> list;
+			if (PlaylistFile::parse(arg, &list, nullptr) && !list.empty()) {
+				for (PlaylistFile::Item const &item : list) {
+					items.push_back(item.file);
+				}
+				continue;
+			}
+		}
+		items.push_back(arg);
+	}
+	return items;
+}
+
+int cmd_servers(Options const &opts)
+{
+	std::vector<ServerItem> servers;
+	loadPresetServers(&servers);
+	if (opts.json) {
+		QJsonArray array;
+		for (ServerItem const &s : servers) {
+			QJsonObject obj;
+			obj["name"] = s.name;
+			obj["address"] = s.host.address();
+			obj["port"] = s.host.port(DEFAULT_MPD_PORT);
+			obj["description"] = s.description;
+			array.push_back(obj);
+		}
+		print_json(array);
+	} else {
+		for (ServerItem const &s : servers) {
+			print_line(QString("%1\t%2:%3\t%4").arg(s.name).arg(s.host.address()).arg(s.host.port(DEFAULT_MPD_PORT)).arg(s.description));
+		}
+	}
+	return 0;
+}
+
+int cmd_status(MusicPlayerClient *mpc, Options const &opts)
+{
+	MusicPlayerClient::StringMap status;
+	MusicPlayerClient::StringMap song;
+	if (!mpc->do_status(&status) || !mpc->do_currentsong(&song)) {
+		return fail(*mpc);
+	}
+	if (opts.json) {
+		QJsonObject obj;
+		obj["status"] = to_json(status);
+		obj["song"] = to_json(song);
+		print_json(obj);
+	} else {
+		QString title = song.get("Title");
+		if (title.isEmpty()) title = song.get("file");
+		print_line(QString("[%1] %2 - %3").arg(status.get("state")).arg(song.get("Artist")).arg(title));
+		print_line(QString("volume: %1  repeat: %2  random: %3  single: %4  consume: %5")
+				   .arg(status.get("volume")).arg(status.get("repeat")).arg(status.get("random")).arg(status.get("single")).arg(status.get("consume")));
+	}
+	return 0;
+}
+
+int cmd_queue(MusicPlayerClient *mpc, Options const &opts)
+{
+	QList<MusicPlayerClient::Item> items;
+	if (!mpc->do_playlistinfo(QString(), &items)) {
+		return fail(*mpc);
+	}
+	if (opts.json) {
+		QJsonArray array;
+		for (MusicPlayerClient::Item const &item : items) {
+			array.push_back(to_json(item));
+		}
+		print_json(array);
+	} else {
+		for (MusicPlayerClient::Item const &item : items) {
+			QString title = item.map.get("Title");
+			if (title.isEmpty()) title = item.text;
+			print_line(QString("%1\t%2\t%3").arg(item.map.get("Id")).arg(item.map.get("Artist")).arg(title));
+		}
+	}
+	return 0;
+}
+
+// トップレベルのディレクトリごとに listallinfo し、取れた分から書き出す。巨大なライブラリでも全体を抱え込まない
+int cmd_dump(MusicPlayerClient *mpc, QString const &path)
+{
+	QList<MusicPlayerClient::Item> toplevel;
+	if (!mpc->do_lsinfo(path, &toplevel)) {
+		return fail(*mpc);
+	}
+	fputs("[\n", stdout);
+	bool first = true;
+	auto write = [&](MusicPlayerClient::Item const &item){
+		QByteArray ba = QJsonDocument(to_json(item)).toJson(QJsonDocument::Compact);
+		if (!first) fputs(",\n", stdout);
+		fwrite(ba.data(), 1, ba.size(), stdout);
+		first = false;
+	};
+	for (MusicPlayerClient::Item const &item : toplevel) {
+		write(item);
+		if (item.kind != "directory") continue;
+		QList<MusicPlayerClient::Item> items;
+		if (!mpc->do_listallinfo(item.text, &items)) {
+			fputs("\n]\n", stdout);
+			return fail(*mpc);
+		}
+		for (MusicPlayerClient::Item const &i : items) {
+			write(i);
+		}
+	}
+	fputs("\n]\n", stdout);
+	return 0;
+}
+
+// 変化のたびに {"time":..., "changed":[...], "status":{...}} を 1 行書く。接続が切れたら間をおいてつなぎ直す
+int cmd_idle(MusicPlayerClient *mpc, Host const &host, QStringList const &subsystems)
+{
+	QString sub = subsystems.join(' ');
+	int backoff = 1000;
+	while (1) {
+		if (!mpc->isOpen()) {
+			if (!mpc->open(host)) {
+				fail(*mpc);
+				QThread::msleep(backoff);
+				backoff = std::min(backoff * 2, 30000);
+				continue;
+			}
+			backoff = 1000;
+		}
+		if (!mpc->do_idle(sub)) {
+			mpc->close();
+			continue;
+		}
+		QStringList changed;
+		int r;
+		while ((r = mpc->wait_idle(1000, &changed)) == 0);
+		if (r < 0) {
+			mpc->close();
+			continue;
+		}
+		QJsonObject obj;
+		obj["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+		obj["changed"] = QJsonArray::fromStringList(changed);
+		MusicPlayerClient::StringMap status;
+		if (mpc->do_status(&status)) {
+			obj["status"] = to_json(status);
+		}
+		print_json(obj, true);
+	}
+	return 0;
+}
+
+class LoadWorker : public QThread {
+private:
+	Host host_;
+	QStringList commands_;
+	int rate_;
+	std::atomic<bool> const *stop_;
+protected:
+	void run()
+	{
+		MusicPlayerClient mpc;
+		if (!mpc.open(host_)) {
+			errors++;
+			return;
+		}
+		QElapsedTimer t;
+		t.start();
+		qint64 n = 0;
+		while (!*stop_) {
+			QStringList lines;
+			if (!mpc.do_command(commands_[n % commands_.size()], &lines)) {
+				errors++;
+				if (!mpc.ping(1)) break;
+			}
+			n++;
+			if (rate_ > 0) { // 1 接続あたり毎秒 rate_ 回に抑える
+				qint64 wait = n * 1000 / rate_ - t.elapsed();
+				if (wait > 0) QThread::msleep(wait);
+			}
+		}
+		ops = n;
+		mpc.close();
+	}
+public:
+	qint64 ops = 0;
+	int errors = 0;
+	LoadWorker(Host const &host, QStringList const &commands, int rate, std::atomic<bool> const *stop)
+		: host_(host)
+		, commands_(commands)
+		, rate_(rate)
+		, stop_(stop)
+	{
+	}
+};
+
+int cmd_load(Host const &host, QStringList args, Options const &opts)
+{
+	int connections = 4;
+	int seconds = 10;
+	int rate = 0;
+	while (!args.isEmpty() && args.front().startsWith('-') && args.size() >= 2) {
+		QString a = args.takeFirst();
+		int v = args.takeFirst().toInt();
+		if (a == "-c") {
+			connections = std::max(1, v);
+		} else if (a == "-t") {
+			seconds = std::max(1, v);
+		} else if (a == "-r") {
+			rate = std::max(0, v);
+		} else {
+			usage();
+			return EXIT_USAGE;
+		}
+	}
+	QStringList commands = args.isEmpty() ? QStringList() << "status" << "currentsong" : args;
+
+	CommandMetrics::reset();
+	std::atomic<bool> stop(false);
+	std::vector<std::unique_ptr<LoadWorker>> workers;
+	for (int i = 0; i < connections; i++) {
+		workers.emplace_back(new LoadWorker(host, commands, rate, &stop));
+		workers.back()->start();
+	}
+	QThread::sleep(seconds);
+	stop = true;
+	qint64 ops = 0;
+	int errors = 0;
+	for (auto &w : workers) {
+		w->wait();
+		ops += w->ops;
+		errors += w->errors;
+	}
+
+	QList<CommandMetrics::Summary> list = CommandMetrics::snapshot();
+	if (opts.json) {
+		QJsonDocument doc = QJsonDocument::fromJson(CommandMetrics::toJson(list));
+		QJsonObject obj;
+		obj["connections"] = connections;
+		obj["seconds"] = seconds;
+		obj["ops"] = ops;
+		obj["ops_per_sec"] = (double)ops / seconds;
+		obj["errors"] = errors;
+		obj["commands"] = doc.object()["commands"];
+		print_json(obj);
+	} else {
+		fprintf(stderr, "%d connections, %d s: %lld ops (%.1f ops/s), %d errors\n", connections, seconds, (long long)ops, (double)ops / seconds, errors);
+		QByteArray csv = CommandMetrics::toCsv(list);
+		fwrite(csv.data(), 1, csv.size(), stdout);
+	}
+	return errors > 0 ? 1 : 0;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	ApplicationGlobal g;
+	global = &g;
+	global->organization_name = ORGANIZATION_NAME;
+	global->application_name = APPLICATION_NAME;
+
+	QCoreApplication app(argc, argv);
+	app.setOrganizationName(global->organization_name);
+	app.setApplicationName(global->application_name);
+	global->application_data_dir = makeApplicationDataDir();
+
+	Options opts;
+	QString server_name;
+	QString address;
+	QString password;
+	QStringList args = app.arguments();
+	args.removeFirst();
+	while (!args.isEmpty() && args.front().startsWith('-')) {
+		QString a = args.takeFirst();
+		if (a == "--json") {
+			opts.json = true;
+		} else if ((a == "-s" || a == "-H" || a == "-P") && !args.isEmpty()) {
+			QString v = args.takeFirst();
+			if (a == "-s") server_name = v;
+			if (a == "-H") address = v;
+			if (a == "-P") password = v;
+		} else if (a == "-h" || a == "--help") {
+			usage();
+			return 0;
+		} else {
+			usage();
+			return EXIT_USAGE;
+		}
+	}
+	if (args.isEmpty()) {
+		usage();
+		return EXIT_USAGE;
+	}
+	QString cmd = args.takeFirst();
+
+	if (cmd == "servers") {
+		return cmd_servers(opts);
+	}
+
+	bool ok;
+	Host host = resolve_host(server_name, address, password, &ok);
+	if (!ok) return 1;
+
+	if (cmd == "load") {
+		return cmd_load(host, args, opts);
+	}
+
+	MusicPlayerClient mpc;
+	if (!mpc.open(host)) {
+		return fail(mpc);
+	}
+
+	if (cmd == "idle") {
+		return cmd_idle(&mpc, host, args);
+	}
+
+	int ret = 0;
+	if (cmd == "status") {
+		ret = cmd_status(&mpc, opts);
+	} else if (cmd == "queue") {
+		ret = cmd_queue(&mpc, opts);
+	} else if (cmd == "dump") {
+		ret = cmd_dump(&mpc, args.isEmpty() ? QString() : args.front());
+	} else if (cmd == "play") {
+		ok = mpc.do_play(args.isEmpty() ? -1 : args.front().toInt());
+	} else if (cmd == "pause") {
+		ok = mpc.do_pause(true);
+	} else if (cmd == "stop") {
+		ok = mpc.do_stop();
+	} else if (cmd == "next") {
+		ok = mpc.do_next();
+	} else if (cmd == "prev") {
+		ok = mpc.do_previous();
+	} else if (cmd == "setvol" && args.size() == 1) {
+		ok = mpc.do_setvol(args.front().toInt());
+	} else if (cmd == "clear") {
+		ok = mpc.do_clear();
+	} else if (cmd == "add" || cmd == "insert") {
+		int pos = -1;
+		if (cmd == "insert") {
+			if (args.isEmpty()) {
+				usage();
+				return EXIT_USAGE;
+			}
+			pos = args.takeFirst().toInt();
+		}
+		bool resolve = true;
+		if (!args.isEmpty() && args.front() == "--no-resolve") {
+			args.removeFirst();
+			resolve = false;
+		}
+		QStringList items = expand_items(args, resolve);
+		QStringList failed;
+		ok = pos < 0 ? mpc.do_add(items, &failed) : mpc.do_addid(items, pos, &failed);
+		for (QString const &item : failed) {
+			fprintf(stderr, "skympc-cli: failed to add: %s\n", item.toUtf8().constData());
+		}
+		fprintf(stderr, "%d added\n", items.size() - failed.size());
+	} else if (cmd == "delete") {
+		QList<int> ids;
+		for (QString const &a : args) {
+			ids.push_back(a.toInt());
+		}
+		ok = mpc.do_deleteid(ids);
+	} else if (cmd == "raw" && !args.isEmpty()) {
+		QStringList lines;
+		ok = mpc.do_command(args.join(' '), &lines);
+		for (QString const &line : lines) {
+			print_line(line);
+		}
+	} else {
+		usage();
+		ret = EXIT_USAGE;
+	}
+	if (!ok) {
+		ret = fail(mpc);
+	}
+	mpc.close();
+	return ret;
+}
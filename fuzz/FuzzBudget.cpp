@@ -0,0 +1,151 @@
+#include "FuzzBudget.h"
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define FUZZ_SANITIZER_HOOKS 1
+#endif
+#elif defined(__SANITIZE_ADDRESS__)
+#define FUZZ_SANITIZER_HOOKS 1
+#endif
+
+#if FUZZ_SANITIZER_HOOKS
+// <sanitizer/allocator_interface.h> がないツールチェインもあるので自分で宣言する
+extern "C" {
+int __sanitizer_install_malloc_and_free_hooks(void (*malloc_hook)(const volatile void *, size_t), void (*free_hook)(const volatile void *));
+size_t __sanitizer_get_allocated_size(const volatile void *p);
+}
+#else
+#include <malloc.h>
+#endif
+
+namespace {
+
+std::atomic<size_t> live_bytes {0};
+std::atomic<size_t> peak_bytes {0};
+
+void allocated(size_t n)
+{
+	size_t live = live_bytes += n;
+	size_t peak = peak_bytes;
+	while (live > peak && !peak_bytes.compare_exchange_weak(peak, live));
+}
+
+void freed(size_t n)
+{
+	live_bytes -= n;
+}
+
+unsigned long long env(char const *name, unsigned long long def)
+{
+	char const *s = getenv(name);
+	return s && *s ? strtoull(s, nullptr, 10) : def;
+}
+
+struct Limits {
+	unsigned long long time_ms;
+	unsigned long long time_ns_per_byte;
+	unsigned long long memory_mb;
+	unsigned long long memory_per_byte;
+	Limits()
+	{
+		time_ms = env("FUZZ_TIME_MS", 50);
+		time_ns_per_byte = env("FUZZ_TIME_NS_PER_BYTE", 2000);
+		memory_mb = env("FUZZ_MEMORY_MB", 32);
+		memory_per_byte = env("FUZZ_MEMORY_PER_BYTE", 256);
+	}
+};
+
+Limits const &limits()
+{
+	static Limits l;
+	return l;
+}
+
+unsigned long long now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#if FUZZ_SANITIZER_HOOKS
+void malloc_hook(const volatile void *, size_t n)
+{
+	allocated(n);
+}
+
+void free_hook(const volatile void *p)
+{
+	if (p) {
+		freed(__sanitizer_get_allocated_size(p));
+	}
+}
+
+struct InstallHooks {
+	InstallHooks()
+	{
+		__sanitizer_install_malloc_and_free_hooks(malloc_hook, free_hook);
+	}
+} install_hooks;
+#endif
+
+}
+
+#if !FUZZ_SANITIZER_HOOKS
+void *operator new(size_t n)
+{
+	void *p = malloc(n ? n : 1);
+	if (!p) throw std::bad_alloc();
+	allocated(malloc_usable_size(p));
+	return p;
+}
+
+void *operator new[](size_t n)
+{
+	return operator new(n);
+}
+
+void operator delete(void *p) noexcept
+{
+	if (p) {
+		freed(malloc_usable_size(p));
+		free(p);
+	}
+}
+
+void operator delete[](void *p) noexcept
+{
+	operator delete(p);
+}
+#endif
+
+FuzzBudget::FuzzBudget(size_t input_size)
+	: size_(input_size)
+{
+	limits();
+	base_bytes_ = live_bytes;
+	peak_bytes = base_bytes_;
+	start_ns_ = now_ns();
+}
+
+FuzzBudget::~FuzzBudget()
+{
+	Limits const &l = limits();
+	size_t peak = peak_bytes;
+	unsigned long long used = peak > base_bytes_ ? peak - base_bytes_ : 0;
+	unsigned long long memory_limit = l.memory_mb * 1024 * 1024 + l.memory_per_byte * size_;
+	if (used > memory_limit) {
+		fprintf(stderr, "==fuzz budget== %zu byte input used %llu bytes at peak (limit %llu bytes)\n", size_, used, memory_limit);
+		abort();
+	}
+	unsigned long long elapsed = now_ns() - start_ns_;
+	unsigned long long time_limit = l.time_ms * 1000000ULL + l.time_ns_per_byte * size_;
+	if (elapsed > time_limit) {
+		fprintf(stderr, "==fuzz budget== %zu byte input took %.3f ms (limit %.3f ms)\n", size_, elapsed / 1e6, time_limit / 1e6);
+		abort();
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef FUZZBUDGET_H
+#define FUZZBUDGET_H
+
+#include <stddef.h>
+
+// 1 回の入力にかけてよい時間とメモリの上限。スコープを抜けるときに超えていれば abort() し、
+// ファザーにクラッシュとして記録させる。入力の大きさに比例して上限を広げるので、二乗で遅くなる処理や
+// 入力に比べて桁違いにメモリを使う処理がひっかかる。
+//
+// 上限は環境変数で変えられる
+//   FUZZ_TIME_MS (50) + FUZZ_TIME_NS_PER_BYTE (2000) x 入力のバイト数
+//   FUZZ_MEMORY_MB (32) + FUZZ_MEMORY_PER_BYTE (256) x 入力のバイト数
+//
+// メモリはサニタイザ付きでビルドしたときは malloc まで、そうでなければ operator new の分だけ数える。
+class FuzzBudget {
+private:
+	size_t size_;
+	unsigned long long start_ns_;
+	size_t base_bytes_;
+public:
+	FuzzBudget(size_t input_size);
+	~FuzzBudget();
+};
+
+#endif // FUZZBUDGET_H
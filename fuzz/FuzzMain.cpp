@@ -0,0 +1,47 @@
+// libFuzzer を使わないときの main。AFL から標準入力で、または再現のためにファイルを並べて渡す
+//   afl-fuzz -i corpus -o findings -- ./fuzz_playlist
+//   ./fuzz_playlist crash-1234 crash-5678
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size);
+
+static std::vector<uint8_t> read_all(FILE *fp)
+{
+	std::vector<uint8_t> buf;
+	uint8_t tmp[65536];
+	size_t n;
+	while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) {
+		buf.insert(buf.end(), tmp, tmp + n);
+	}
+	return buf;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+#ifdef __AFL_LOOP
+		while (__AFL_LOOP(1000)) {
+#endif
+			std::vector<uint8_t> buf = read_all(stdin);
+			LLVMFuzzerTestOneInput(buf.data(), buf.size());
+#ifdef __AFL_LOOP
+		}
+#endif
+		return 0;
+	}
+	for (int i = 1; i < argc; i++) {
+		FILE *fp = fopen(argv[i], "rb");
+		if (!fp) {
+			fprintf(stderr, "%s: cannot open\n", argv[i]);
+			return 1;
+		}
+		std::vector<uint8_t> buf = read_all(fp);
+		fclose(fp);
+		fprintf(stderr, "%s: %zu bytes\n", argv[i], buf.size());
+		LLVMFuzzerTestOneInput(buf.data(), buf.size());
+	}
+	return 0;
+}
@@ -0,0 +1,29 @@
+# ファジング用ターゲットの共通設定
+#   libFuzzer: qmake -r CONFIG+=libfuzzer QMAKE_CXX=clang++ QMAKE_LINK=clang++ fuzz.pro
+#   AFL:       qmake -r QMAKE_CXX=afl-clang-fast++ QMAKE_LINK=afl-clang-fast++ fuzz.pro
+# 時間とメモリの上限は FuzzBudget.h を参照
+
+QT       += core network
+QT       -= gui
+
+TEMPLATE = app
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DESTDIR = $$PWD/../_bin/fuzz
+
+unix:QMAKE_CXXFLAGS += -Wall -Wextra -Werror=return-type -Werror=trigraphs -Wno-switch -g
+
+INCLUDEPATH += $$PWD $$PWD/../bench $$PWD/../src
+
+SOURCES += $$PWD/FuzzBudget.cpp
+HEADERS += $$PWD/FuzzBudget.h \
+    $$PWD/../bench/ParserHarness.h
+
+libfuzzer {
+	QMAKE_CXXFLAGS += -fsanitize=fuzzer,address,undefined
+	QMAKE_LFLAGS += -fsanitize=fuzzer,address,undefined
+} else {
+	SOURCES += $$PWD/FuzzMain.cpp
+}
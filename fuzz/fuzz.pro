@@ -0,0 +1,7 @@
+# 信用できない入力を扱う解析処理のファジング
+TEMPLATE = subdirs
+
+SUBDIRS = playlist \
+    url \
+    http \
+    mpd_recv
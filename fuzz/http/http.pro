@@ -0,0 +1,19 @@
+include(../fuzz.pri)
+
+TARGET = fuzz_http
+
+SOURCES += main.cpp \
+    ../../src/StreamProbe.cpp \
+    ../../src/webclient.cpp
+
+HEADERS += ../../src/StreamProbe.h \
+    ../../src/webclient.h
+
+!contains(DEFINES, USE_OPENSSL=0) {
+	unix:LIBS += -lssl -lcrypto
+	win32:LIBS += -llibssl -llibcrypto
+}
+!contains(DEFINES, USE_ZLIB=0) {
+	unix:LIBS += -lz
+	win32:LIBS += -lzlib
+}
@@ -0,0 +1,33 @@
+// HTTP レスポンスの受信。ヘッダの解析と StreamProbeHandler による判定を、実際の受信と同じく細切れに渡して確かめる。
+// 先頭の 1 バイトで 1 回に渡す大きさを決める
+
+#include "FuzzBudget.h"
+#include "ParserHarness.h"
+#include "StreamProbe.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size)
+{
+	if (size < 1) return 0;
+	FuzzBudget budget(size);
+	size_t chunk = data[0] + 1;
+	char const *ptr = (char const *)data + 1;
+	char const *end = (char const *)data + size;
+	WebClient wc(nullptr);
+	StreamProbeHandler handler(false, 1024 * 1024);
+	try {
+		ParserHarness::httpBegin(&wc);
+		while (ptr < end) {
+			size_t n = std::min(chunk, (size_t)(end - ptr));
+			ParserHarness::httpReceive(&wc, ptr, n, &handler);
+			ptr += n;
+		}
+		handler.finish();
+		wc.content_type();
+		wc.content_length();
+	} catch (WebClient::Error const &) {
+	}
+	return 0;
+}
@@ -0,0 +1,25 @@
+// MusicPlayerClient::recv と parse_result。ソケットの代わりに QBuffer から MPD の応答を読ませる
+
+#include "FuzzBudget.h"
+#include "ParserHarness.h"
+
+#include <QBuffer>
+#include <stdint.h>
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size)
+{
+	static MusicPlayerClient mpc;
+	FuzzBudget budget(size);
+	QBuffer buf;
+	buf.setData((char const *)data, (int)size);
+	buf.open(QBuffer::ReadOnly);
+	QStringList lines;
+	QByteArray binary;
+	ParserHarness::mpdRecv(&mpc, &buf, &lines, &binary);
+	QList<MusicPlayerClient::Item> items;
+	ParserHarness::mpdParse(&mpc, lines, &items);
+	MusicPlayerClient::StringMap map;
+	ParserHarness::mpdParse(&mpc, lines, &map);
+	mpc.message();
+	return 0;
+}
@@ -0,0 +1,12 @@
+include(../fuzz.pri)
+
+TARGET = fuzz_mpd_recv
+
+SOURCES += main.cpp \
+    ../../src/MusicPlayerClient.cpp \
+    ../../src/CommandMetrics.cpp \
+    ../../src/ProtocolTrace.cpp
+
+HEADERS += ../../src/MusicPlayerClient.h \
+    ../../src/CommandMetrics.h \
+    ../../src/ProtocolTrace.h
@@ -0,0 +1,39 @@
+// PlaylistFile の各形式の解析。先頭の 1 バイトで形式を選ぶ
+
+#include "ApplicationGlobal.h"
+#include "FuzzBudget.h"
+#include "ParserHarness.h"
+
+#include <stdint.h>
+
+ApplicationGlobal *global = nullptr;
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const *data, size_t size)
+{
+	if (size < 1) return 0;
+	FuzzBudget budget(size);
+	char const *begin = (char const *)data + 1;
+	char const *end = (char const *)data + size;
+	std::vector<PlaylistFile::Item> items;
+	switch (data[0] % 6) {
+	case 0:
+		ParserHarness::parsePls(begin, end, &items);
+		break;
+	case 1:
+		ParserHarness::parseM3u(begin, end, &items, "http://example.com/live/index.m3u8");
+		break;
+	case 2:
+		ParserHarness::parseXspf(begin, end, &items);
+		break;
+	case 3:
+		ParserHarness::parseAsx(begin, end, &items);
+		break;
+	case 4:
+		ParserHarness::parseJson(begin, end, &items);
+		break;
+	case 5:
+		ParserHarness::sniff("audio/x-scpls", "http://example.com/listen", begin, end);
+		break;
+	}
+	return 0;
+}
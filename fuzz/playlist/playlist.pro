@@ -0,0 +1,25 @@
+include(../fuzz.pri)
+
+TARGET = fuzz_playlist
+
+SOURCES += main.cpp \
+    ../../src/PlaylistFile.cpp \
+    ../../src/StreamProbe.cpp \
+    ../../src/MemoryReader.cpp \
+    ../../src/pathcat.cpp \
+    ../../src/webclient.cpp
+
+HEADERS += ../../src/PlaylistFile.h \
+    ../../src/StreamProbe.h \
+    ../../src/MemoryReader.h \
+    ../../src/pathcat.h \
+    ../../src/webclient.h
+
+!contains(DEFINES, USE_OPENSSL=0) {
+	unix:LIBS += -lssl -lcrypto
+	win32:LIBS += -llibssl -llibcrypto
+}
+!contains(DEFINES, USE_ZLIB=0) {
+	unix:LIBS += -lz
+	win32:LIBS += -lzlib
+}
@@ -0,0 +1,157 @@
+#include "AlbumArtCache.h"
+#include "ApplicationGlobal.h"
+#include "MusicPlayerClient.h"
+#include "pathcat.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+AlbumArtCache::AlbumArtCache()
+{
+	dir_ = pathcat(global->application_data_dir, "albumart");
+}
+
+QString AlbumArtCache::makeKey(Host const &host, QString const &path)
+{
+	QString dir = path; // ルート直下の曲はまとめずに曲ごとに分ける
+	int i = path.lastIndexOf('/');
+	if (i > 0) {
+		dir = path.mid(0, i);
+	}
+	QString key = host.address() + ':' + QString::number(host.port(DEFAULT_MPD_PORT)) + '\n' + dir;
+	return QString::fromLatin1(QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+QString AlbumArtCache::filePath(QString const &key) const
+{
+	return pathcat(dir_, key + ".png");
+}
+
+void AlbumArtCache::setMaxBytes(qint64 bytes)
+{
+	QMutexLocker lock(&mutex_);
+	max_bytes_ = bytes;
+	insert_(QString(), QImage()); // 上限を超えた分を追い出す
+}
+
+void AlbumArtCache::setMaxDiskBytes(qint64 bytes)
+{
+	{
+		QMutexLocker lock(&disk_mutex_);
+		max_disk_bytes_ = bytes;
+	}
+	trimDisk(0);
+}
+
+// 保存した分を足して、上限を超えていたら更新の古いものから上限の 3/4 まで消す
+void AlbumArtCache::trimDisk(qint64 added)
+{
+	QMutexLocker lock(&disk_mutex_);
+	QDir dir(dir_);
+	QStringList const filter = { "*.png" };
+	if (disk_bytes_ < 0) {
+		disk_bytes_ = 0;
+		for (QFileInfo const &fi : dir.entryInfoList(filter, QDir::Files)) {
+			disk_bytes_ += fi.size();
+		}
+	} else {
+		disk_bytes_ += added;
+	}
+	if (disk_bytes_ <= max_disk_bytes_) return;
+
+	QFileInfoList list = dir.entryInfoList(filter, QDir::Files, QDir::Time | QDir::Reversed);
+	disk_bytes_ = 0;
+	for (QFileInfo const &fi : list) {
+		disk_bytes_ += fi.size();
+	}
+	for (QFileInfo const &fi : list) {
+		if (disk_bytes_ <= max_disk_bytes_ * 3 / 4) break;
+		if (QFile::remove(fi.filePath())) {
+			disk_bytes_ -= fi.size();
+		}
+	}
+}
+
+void AlbumArtCache::insert_(QString const &key, QImage const &image)
+{
+	if (!key.isEmpty()) {
+		auto it = map_.find(key);
+		if (it != map_.end()) {
+			bytes_ -= it->second->bytes;
+			lru_.erase(it->second);
+			map_.erase(it);
+		}
+		Entry e;
+		e.key = key;
+		e.image = image;
+		e.bytes = image.sizeInBytes() + key.size() * 2; // 画像がない場合も覚えておく
+		bytes_ += e.bytes;
+		lru_.push_front(e);
+		map_[key] = lru_.begin();
+	}
+	while (bytes_ > max_bytes_ && !lru_.empty()) {
+		Entry const &e = lru_.back();
+		bytes_ -= e.bytes;
+		map_.erase(e.key);
+		lru_.pop_back();
+	}
+}
+
+bool AlbumArtCache::find(QString const &key, QImage *out)
+{
+	QMutexLocker lock(&mutex_);
+	auto it = map_.find(key);
+	if (it == map_.end()) {
+		return false;
+	}
+	lru_.splice(lru_.begin(), lru_, it->second);
+	*out = it->second->image;
+	return true;
+}
+
+bool AlbumArtCache::load(QString const &key, QImage *out)
+{
+	QImage image;
+	QFile file(filePath(key));
+	if (!file.open(QFile::ReadWrite) || !image.load(&file, "PNG")) {
+		return false;
+	}
+	file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime); // 使ったものは消されにくくする
+	file.close();
+	QMutexLocker lock(&mutex_);
+	insert_(key, image);
+	*out = image;
+	return true;
+}
+
+void AlbumArtCache::insert(QString const &key, QImage const &image)
+{
+	{
+		QMutexLocker lock(&mutex_);
+		insert_(key, image);
+	}
+	if (!image.isNull()) {
+		if (!QFileInfo(dir_).isDir()) {
+			QDir().mkpath(dir_);
+		}
+		QString path = filePath(key);
+		QString tmp = path + ".tmp";
+		if (image.save(tmp, "PNG")) {
+			QFile::remove(path);
+			if (QFile::rename(tmp, path)) {
+				trimDisk(QFileInfo(path).size());
+			}
+		}
+	}
+}
+
+void AlbumArtCache::clear()
+{
+	QMutexLocker lock(&mutex_);
+	lru_.clear();
+	map_.clear();
+	bytes_ = 0;
+}
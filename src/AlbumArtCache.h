@@ -0,0 +1,44 @@
+#ifndef ALBUMARTCACHE_H
+#define ALBUMARTCACHE_H
+
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <list>
+#include <map>
+
+class Host;
+
+// アルバムアートのキャッシュ。表示サイズに縮小済みの画像をメモリ上に LRU で保持し、
+// ディスク上にはサーバとディレクトリから求めたハッシュ名で保存し、上限を超えたら古いものから消す。
+class AlbumArtCache {
+private:
+	struct Entry {
+		QString key;
+		QImage image;
+		qint64 bytes;
+	};
+	mutable QMutex mutex_;
+	std::list<Entry> lru_;
+	std::map<QString, std::list<Entry>::iterator> map_;
+	qint64 bytes_ = 0;
+	qint64 max_bytes_ = 16 * 1024 * 1024;
+	QString dir_;
+	QMutex disk_mutex_;
+	qint64 disk_bytes_ = -1; // 未集計なら -1
+	qint64 max_disk_bytes_ = 64 * 1024 * 1024;
+	void insert_(QString const &key, QImage const &image);
+	void trimDisk(qint64 added);
+	QString filePath(QString const &key) const;
+public:
+	AlbumArtCache();
+	static QString makeKey(Host const &host, QString const &path);
+	void setMaxBytes(qint64 bytes);
+	void setMaxDiskBytes(qint64 bytes);
+	bool find(QString const &key, QImage *out);
+	bool load(QString const &key, QImage *out);
+	void insert(QString const &key, QImage const &image);
+	void clear();
+};
+
+#endif // ALBUMARTCACHE_H
@@ -0,0 +1,184 @@
+#include "AlbumArtThread.h"
+#include "AlbumArtCache.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+
+struct AlbumArtThread::Private {
+	QMutex mutex;
+	QWaitCondition cond;
+	Host host;
+	QSize image_size = QSize(64, 64);
+	AlbumArtCache *cache = nullptr;
+	std::deque<QString> queue;
+	std::deque<QString> prefetch_queue;
+	int prefetch_pos = -1;
+	int prefetch_count = 0;
+};
+
+AlbumArtThread::AlbumArtThread()
+{
+	pv = new Private();
+}
+
+AlbumArtThread::~AlbumArtThread()
+{
+	requestInterruption();
+	pv->cond.wakeAll();
+	wait();
+	delete pv;
+}
+
+void AlbumArtThread::setHost(Host const &host)
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->host = host;
+	pv->queue.clear();
+	pv->prefetch_queue.clear();
+	pv->prefetch_pos = -1;
+}
+
+void AlbumArtThread::setImageSize(QSize const &size)
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->image_size = size;
+}
+
+void AlbumArtThread::setCache(AlbumArtCache *cache)
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->cache = cache;
+}
+
+void AlbumArtThread::prefetch(int pos, int count)
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->prefetch_queue.clear(); // 古い先読みは捨てて、新しい位置から読み直す
+	pv->prefetch_pos = pos;
+	pv->prefetch_count = count;
+	pv->cond.wakeOne();
+}
+
+void AlbumArtThread::request(QString const &path)
+{
+	QMutexLocker lock(&pv->mutex);
+	for (auto it = pv->queue.begin(); it != pv->queue.end(); it++) {
+		if (*it == path) {
+			pv->queue.erase(it);
+			break;
+		}
+	}
+	pv->queue.push_front(path); // 今再生中の曲を最優先にする
+	pv->cond.wakeOne();
+}
+
+// 画像がないとサーバが答えたときは *absent を true にする。通信の失敗ならそのまま
+bool AlbumArtThread::fetch(MusicPlayerClient *mpc, QString const &path, QImage *out, bool *absent)
+{
+	*out = QImage();
+	*absent = false;
+	QByteArray data;
+	bool ok = mpc->do_albumart(path, &data);
+	if (!ok && mpc->message().isEmpty()) { // ACK 以外の失敗
+		return false;
+	}
+	if (data.isEmpty()) { // フォルダに画像がなければ埋め込まれた画像を探す
+		ok = mpc->do_readpicture(path, &data);
+		if (!ok && mpc->message().isEmpty()) {
+			return false;
+		}
+	}
+	QImage image;
+	if (data.isEmpty() || !image.loadFromData(data)) {
+		*absent = true;
+		return false;
+	}
+	*out = scaled(image);
+	return true;
+}
+
+QImage AlbumArtThread::scaled(QImage const &image) const
+{
+	QSize size;
+	{
+		QMutexLocker lock(&pv->mutex);
+		size = pv->image_size;
+	}
+	if (image.isNull() || (image.width() <= size.width() && image.height() <= size.height())) {
+		return image;
+	}
+	return image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+void AlbumArtThread::run()
+{
+	MusicPlayerClient mpc;
+	Host host;
+	while (!isInterruptionRequested()) {
+		QString path;
+		bool prefetch = false;
+		int pos = -1;
+		int count = 0;
+		AlbumArtCache *cache;
+		{
+			QMutexLocker lock(&pv->mutex);
+			if (!pv->queue.empty()) {
+				path = pv->queue.front();
+				pv->queue.pop_front();
+			} else if (pv->prefetch_pos >= 0) {
+				pos = pv->prefetch_pos;
+				count = pv->prefetch_count;
+				pv->prefetch_pos = -1;
+			} else if (!pv->prefetch_queue.empty()) {
+				path = pv->prefetch_queue.front();
+				pv->prefetch_queue.pop_front();
+				prefetch = true;
+			} else {
+				pv->cond.wait(&pv->mutex, 500);
+				continue;
+			}
+			if (host != pv->host) {
+				host = pv->host;
+				mpc.close();
+			}
+			cache = pv->cache;
+		}
+		if (!mpc.isOpen()) {
+			mpc.open(host);
+		}
+
+		if (pos >= 0) { // 先読みする曲のパスをキューから調べる
+			QList<MusicPlayerClient::Item> items;
+			if (mpc.isOpen() && mpc.do_playlistinfo(QString::number(pos) + ':' + QString::number(pos + count), &items)) {
+				QMutexLocker lock(&pv->mutex);
+				for (MusicPlayerClient::Item const &item : items) {
+					if (item.kind == "file" && item.text.indexOf("://") < 0) {
+						pv->prefetch_queue.push_back(item.text);
+					}
+				}
+			}
+			continue;
+		}
+
+		QString key = AlbumArtCache::makeKey(host, path);
+		QImage image;
+		if (cache && cache->find(key, &image)) {
+			// hit
+		} else if (cache && cache->load(key, &image)) {
+			image = scaled(image);
+		} else {
+			bool absent = false;
+			if (mpc.isOpen()) {
+				fetch(&mpc, path, &image, &absent);
+			}
+			if (cache && (!image.isNull() || absent)) { // 一時的な失敗は覚えず、次の要求でやり直す
+				cache->insert(key, image);
+			}
+		}
+		if (!prefetch) {
+			emit imageReady(path, image);
+		}
+	}
+	mpc.close();
+}
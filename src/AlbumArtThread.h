@@ -0,0 +1,33 @@
+#ifndef ALBUMARTTHREAD_H
+#define ALBUMARTTHREAD_H
+
+#include "MusicPlayerClient.h"
+
+#include <QImage>
+#include <QThread>
+
+class AlbumArtCache;
+
+// albumart / readpicture で画像を取得し、デコードと縮小までを行うスレッド
+class AlbumArtThread : public QThread {
+	Q_OBJECT
+private:
+	struct Private;
+	Private *pv;
+	bool fetch(MusicPlayerClient *mpc, QString const &path, QImage *out, bool *absent);
+	QImage scaled(QImage const &image) const;
+protected:
+	void run();
+public:
+	AlbumArtThread();
+	~AlbumArtThread();
+	void setHost(Host const &host);
+	void setImageSize(QSize const &size);
+	void setCache(AlbumArtCache *cache);
+	void request(QString const &path);
+	void prefetch(int pos, int count);
+signals:
+	void imageReady(QString const &path, QImage const &image);
+};
+
+#endif // ALBUMARTTHREAD_H
@@ -24,13 +24,30 @@ BasicMainWindow::BasicMainWindow(QWidget *parent)
 {
 	m = new Private();
 	connect(&m->volume_popup, SIGNAL(valueChanged()), this, SLOT(onVolumeChanged()));
-	connect(&m->status_thread, SIGNAL(onUpdate()), this, SLOT(onUpdateStatus()));
+	connect(&m->status_thread, SIGNAL(stateChanged()), this, SLOT(onStateChanged()));
+	connect(&m->status_thread, SIGNAL(songChanged()), this, SLOT(onSongChanged()));
+	connect(&m->status_thread, SIGNAL(optionsChanged()), this, SLOT(onOptionsChanged()));
+	connect(&m->status_thread, SIGNAL(volumeChanged()), this, SLOT(onPlayerVolumeChanged()));
+	connect(&m->status_thread, SIGNAL(elapsedTick()), this, SLOT(onElapsedTick()));
+	connect(&m->update_scheduler, SIGNAL(flush(unsigned int)), this, SLOT(onFlushUpdates(unsigned int)));
+	connect(&m->update_scheduler, SIGNAL(visibilityChanged(bool)), this, SLOT(onWindowVisibilityChanged(bool)));
+	m->sleep_timer.setSingleShot(true);
+	connect(&m->sleep_timer, SIGNAL(timeout()), this, SLOT(onSleepTimerExpired()));
+
+	connect(&m->albumart_thread, SIGNAL(imageReady(QString,QImage)), this, SLOT(onAlbumArtReady(QString,QImage)));
+
+	m->albumart_thread.setCache(&m->albumart_cache);
 
 	SettingsDialog::loadSettings(&m->appsettings);
+
+	// 状態の変化は表示のフレーム単位でまとめて反映する
+	m->update_scheduler.setWindow(this);
+	m->update_scheduler.setHiddenInterval(m->appsettings.hidden_update_interval);
 }
 
 BasicMainWindow::~BasicMainWindow()
 {
+	stopLibrarySync();
 	stopStatusThread();
 	mpc()->close();
 	delete m;
@@ -95,6 +112,28 @@ void BasicMainWindow::stopStatusThread()
 	m->status_thread.wait(1000);
 }
 
+void BasicMainWindow::startLibrarySync()
+{
+	stopLibrarySync();
+	m->library_sync = new LibrarySyncThread();
+	m->library_sync->setHost(m->host);
+	m->library_sync->setStore(&m->library);
+	m->library_sync->start();
+}
+
+// UI を止めないよう終わるのを待たない。取り消したスレッドは終わったときに自分で消える
+void BasicMainWindow::stopLibrarySync()
+{
+	LibrarySyncThread *thread = m->library_sync;
+	if (!thread) return;
+	m->library_sync = nullptr;
+	thread->cancel();
+	connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
+	if (thread->isFinished() || !thread->isRunning()) {
+		thread->deleteLater();
+	}
+}
+
 void BasicMainWindow::execSleepTimerDialog()
 {
 	MySettings settings;
@@ -132,80 +171,67 @@ void BasicMainWindow::eatMouse()
 	m->release_mouse_event = true;
 }
 
-void BasicMainWindow::updatePlayingStatus()
+void BasicMainWindow::updatePlayingStatus(unsigned int dirty)
 {
 	PlayingStatus status = PlayingStatus::Stop;
 
 	if (mpc()->isOpen()) {
-		PlayingInfo info;
-		m->status_thread.data(&info);
-		QString state = info.status.get("state");
-		if (state == "play") {
-			status = PlayingStatus::Play;
-		} else if (state == "pause") {
-			status = PlayingStatus::Pause;
+		PlayerStatePtr state = m->status_thread.state();
+		if (state) {
+			status = state->status;
 		}
 
-		if (status == PlayingStatus::Stop) {
-			m->total_seconds = 0;
-			m->status.now.index = -1;
-			displayCurrentSongLabels(QString(), QString(), QString());
-			displayStopStatus();
-		} else {
-			m->status.now.index = info.status.get("song").toInt();
-			m->volume = info.status.get("volume").toInt();
-
-			setRepeatEnabled(info.status.get("repeat").toInt() != 0);
-			setSingleEnabled(info.status.get("single").toInt() != 0);
-			setConsumeEnabled(info.status.get("consume").toInt() != 0);
-			setRandomEnabled(info.status.get("random").toInt() != 0);
-
-			QString prop_id = info.property.get("Id");
-			QString prop_artist = info.property.get("Artist");
-			QString prop_album = info.property.get("Album");
-			QString prop_track = info.property.get("Track");
-			QString prop_title = info.property.get("Title");
-			QString prop_file = info.property.get("file");
-
-			if (info.status.get("songid") == prop_id) {
-				m->status.now.title = prop_title;
-				m->status.now.artist = prop_artist;
-				m->status.now.track = prop_track.toInt();
-				m->status.now.disc.clear();
-
-				if (!prop_album.isEmpty()) {
-					if (m->status.now.track > 0) {
-						m->status.now.disc = QString("Tr.") + QString::number(m->status.now.track) + ", ";
-					}
-					m->status.now.disc += prop_album;
-				}
-				if (m->status.now.title.isEmpty()) {
-					QString file = prop_file;
-					int i = file.lastIndexOf('/');
-					if (i >= 0) file = file.mid(i + 1);
-					m->status.now.title = file;
-				}
+		if (state && (dirty & PlayerState::OptionsDirty)) {
+			setRepeatEnabled(state->repeat);
+			setSingleEnabled(state->single);
+			setConsumeEnabled(state->consume);
+			setRandomEnabled(state->random);
+		}
+
+		if (state && (dirty & PlayerState::VolumeDirty)) { // 停止中に変えた音量も反映する
+			m->volume = state->volume;
+		}
 
+		if (status == PlayingStatus::Stop) {
+			if (dirty & (PlayerState::StateDirty | PlayerState::SongDirty)) {
 				m->total_seconds = 0;
-				double elapsed = 0;
-				{
-					std::string s;
-					s = info.status.get("time").toStdString();
-					int t, e;
-					if (sscanf(s.c_str(), "%d:%d", &e, &t) == 2) {
-						elapsed = e;
-						m->total_seconds = t;
+				m->status.now.index = -1;
+				displayCurrentSongLabels(QString(), QString(), QString());
+				displayStopStatus();
+			}
+		} else {
+			// 停止中も song は報告されるので、停止から同じ曲を再生すると StateDirty だけが来る。
+			// 停止時に消した位置と曲の情報はそのときにも設定し直す
+			PlayerState::Song const &song = state->current;
+			if (dirty & (PlayerState::StateDirty | PlayerState::SongDirty)) {
+				m->status.now.index = state->song;
+				m->next_song = state->nextsong;
+				if (song.valid) {
+					m->status.now.title = song.title;
+					m->status.now.artist = song.artist;
+					m->status.now.file = song.file;
+					m->status.now.track = song.track;
+					m->status.now.disc.clear();
+
+					if (!song.album.isEmpty()) {
+						if (m->status.now.track > 0) {
+							m->status.now.disc = QString("Tr.") + QString::number(m->status.now.track) + ", ";
+						}
+						m->status.now.disc += song.album;
 					}
-				}
-				{
-					bool ok = false;
-					double e = info.status.get("elapsed").toDouble(&ok);
-					if (ok) {
-						elapsed = e;
+					if (m->status.now.title.isEmpty()) {
+						QString file = song.file;
+						int i = file.lastIndexOf('/');
+						if (i >= 0) file = file.mid(i + 1);
+						m->status.now.title = file;
 					}
 				}
-				seekProgressSlider(elapsed, m->total_seconds);
-				displayProgress(elapsed);
+			}
+
+			if (song.valid && (dirty & (PlayerState::StateDirty | PlayerState::SongDirty | PlayerState::ElapsedDirty))) {
+				m->total_seconds = state->total;
+				seekProgressSlider(state->elapsed, m->total_seconds);
+				displayProgress(state->elapsed);
 			}
 		}
 	}
@@ -217,6 +243,32 @@ void BasicMainWindow::updatePlayingStatus()
 	}
 }
 
+void BasicMainWindow::updateAlbumArt()
+{
+	QString file;
+	if (m->connected && (m->status.now.status == PlayingStatus::Play || m->status.now.status == PlayingStatus::Pause)) {
+		file = m->status.now.file;
+	}
+	if (file == m->albumart_file) return;
+	m->albumart_file = file;
+
+	if (file.isEmpty() || file.indexOf("://") > 0) { // ストリームには画像がない
+		displayAlbumArt(QImage());
+		return;
+	}
+
+	QImage image;
+	if (m->albumart_cache.find(AlbumArtCache::makeKey(m->host, file), &image)) {
+		displayAlbumArt(image);
+	} else {
+		m->albumart_thread.request(file);
+	}
+
+	if (m->next_song >= 0) { // 次に再生される曲の画像を先読みしておく
+		m->albumart_thread.prefetch(m->next_song, m->random_enabled ? 1 : 3);
+	}
+}
+
 void BasicMainWindow::displayStopStatus()
 {
 	seekProgressSlider(0, 0);
@@ -276,6 +328,17 @@ void BasicMainWindow::showError(const QString &text)
 	Toast::show(this, text, Toast::LENGTH_LONG);
 }
 
+// まとめて追加したときに飛ばされたものを知らせる
+void BasicMainWindow::showAddFailure(QStringList const &failed)
+{
+	if (failed.isEmpty()) return;
+	QString text = tr("Failed to add:") + ' ' + failed.front();
+	if (failed.size() > 1) {
+		text += QString(" (+%1)").arg(failed.size() - 1);
+	}
+	showError(text);
+}
+
 void BasicMainWindow::update(bool mpdupdate)
 {
 	if (mpdupdate) {
@@ -296,6 +359,7 @@ void BasicMainWindow::checkDisconnected()
 			m->ping_failed_count = 0;
 			setPageDisconnected();
 			clearTreeAndList();
+			updateAlbumArt();
 		}
 	}
 }
@@ -326,6 +390,7 @@ void BasicMainWindow::startSleepTimer(int mins)
 	} else {
 		m->sleep_time = QDateTime();
 	}
+	updateClockTimer();
 }
 
 void BasicMainWindow::doQuickSave1()
@@ -352,13 +417,14 @@ void BasicMainWindow::doQuickLoad2()
 	loadPlaylist("_quick_save_2_", true);
 }
 
-void BasicMainWindow::doUpdateStatus()
+void BasicMainWindow::doUpdateStatus(unsigned int dirty)
 {
-	updatePlayingStatus();
+	updatePlayingStatus(dirty);
 	if (m->status.ago != m->status.now) { // 再生中の曲が変わった？
 		m->status.ago = m->status.now;
 		updatePlaylist();
 	}
+	updateAlbumArt();
 }
 
 void BasicMainWindow::updatePlayIcon(PlayingStatus status, QToolButton *button, QAction *action)
@@ -382,7 +448,53 @@ void BasicMainWindow::updatePlayIcon(PlayingStatus status, QToolButton *button,
 	}
 }
 
-void BasicMainWindow::timerEvent(QTimerEvent *)
+void BasicMainWindow::timerEvent(QTimerEvent *e)
+{
+	if (e->timerId() == m->liveness_timer_id) {
+		checkAlive();
+	} else {
+		tick();
+	}
+}
+
+// ウィンドウが見えていないときは時計と毎秒の ping を止める。
+// 切れた接続には気づけるよう、代わりに間隔を空けて ping だけは続ける。スリープタイマーは時刻どおりに動かす
+void BasicMainWindow::updateClockTimer()
+{
+	bool run = m->clock_enabled && m->update_scheduler.isWindowVisible();
+	if (run && m->clock_timer_id == 0) {
+		m->clock_timer_id = startTimer(1000);
+	} else if (!run && m->clock_timer_id != 0) {
+		killTimer(m->clock_timer_id);
+		m->clock_timer_id = 0;
+	}
+	bool alive = m->clock_enabled && !run;
+	if (alive && m->liveness_timer_id == 0) {
+		m->liveness_timer_id = startTimer(10000, Qt::VeryCoarseTimer);
+	} else if (!alive && m->liveness_timer_id != 0) {
+		killTimer(m->liveness_timer_id);
+		m->liveness_timer_id = 0;
+	}
+	m->sleep_timer.stop();
+	if (!run && m->clock_enabled && m->sleep_time.isValid()) {
+		qint64 ms = QDateTime::currentDateTime().msecsTo(m->sleep_time);
+		m->sleep_timer.start((int)qMax<qint64>(ms, 0));
+	}
+}
+
+// 隠れている間の接続の確認。10 秒おきなので、続けて 2 回失敗したら切断とみなす
+void BasicMainWindow::checkAlive()
+{
+	if (!m->connected) return;
+	if (mpc()->ping(1)) {
+		m->ping_failed_count = 0;
+	} else if (++m->ping_failed_count >= 2) {
+		mpc()->close();
+		checkDisconnected();
+	}
+}
+
+void BasicMainWindow::tick()
 {
 	QString text2;
 	QString text3;
@@ -609,7 +721,8 @@ void BasicMainWindow::preexec()
 
 	updateServersComboBox();
 
-	startTimer(1000);
+	m->clock_enabled = true;
+	updateClockTimer();
 	connectToMPD(m->host);
 }
 
@@ -622,7 +735,11 @@ void BasicMainWindow::connectToMPD(const Host &host)
 	m->ping_failed_count = 0;
 	mpc()->close();
 	stopStatusThread();
+	stopLibrarySync();
 
+	if (m->host != host) {
+		m->library.clear(); // 別のサーバのライブラリは捨てる
+	}
 	m->host = host;
 	if (mpc()->open(m->host)) {
 		m->connected = true;
@@ -656,6 +773,8 @@ void BasicMainWindow::connectToMPD(const Host &host)
 			mpc()->do_setvol(vol);
 		}
 		setVolumeEnabled(m->volume >= 0);
+
+		startLibrarySync();
 	} else {
 		clearTreeAndList();
 		setPageDisconnected();
@@ -677,6 +796,12 @@ void BasicMainWindow::startStatusThread()
 {
 	m->status_thread.setHost(m->host);
 	m->status_thread.start();
+
+	m->albumart_file = QString();
+	m->albumart_thread.setHost(m->host);
+	if (!m->albumart_thread.isRunning()) {
+		m->albumart_thread.start();
+	}
 }
 
 int BasicMainWindow::currentPlaylistCount()
@@ -731,16 +856,19 @@ void BasicMainWindow::addToPlaylist(const QString &path, int to, bool update)
 			to++;
 		}
 	} else if (mpc()->do_listall(path, &fileitems)) {
+		QStringList files;
 		for (mpcitem_t const &mpcitem : fileitems) {
 			if (mpcitem.kind == "file") {
-				if (to < 0) {
-					mpc()->do_add(mpcitem.text);
-				} else {
-					mpc()->do_addid(mpcitem.text, to);
-					to++;
-				}
+				files.push_back(mpcitem.text);
 			}
 		}
+		QStringList failed;
+		if (to < 0) { // まとめて一度に送る
+			mpc()->do_add(files, &failed);
+		} else {
+			mpc()->do_addid(files, to, &failed);
+		}
+		showAddFailure(failed);
 	} else if (mpc()->do_listplaylistinfo(path, &playlist)) {
 		addPlaylsitToPlaylist(path, to);
 	}
@@ -860,11 +988,9 @@ void BasicMainWindow::execAddLocationDialog()
 		} else {
 			locs = text.split('\n', QString::SkipEmptyParts);
 		}
-		for (QString const &loc : locs) {
-			if (!loc.isEmpty()) {
-				mpc()->do_add(loc);
-			}
-		}
+		QStringList failed;
+		mpc()->do_add(locs, &failed);
+		showAddFailure(failed);
 		updatePlaylist();
 	}
 }
@@ -941,9 +1067,59 @@ void BasicMainWindow::onVolumeChanged()
 	mpc()->do_setvol(v);
 }
 
-void BasicMainWindow::onUpdateStatus()
+void BasicMainWindow::onStateChanged()
+{
+	m->update_scheduler.post(PlayerState::StateDirty);
+}
+
+void BasicMainWindow::onSongChanged()
+{
+	m->update_scheduler.post(PlayerState::SongDirty);
+}
+
+void BasicMainWindow::onOptionsChanged()
+{
+	m->update_scheduler.post(PlayerState::OptionsDirty);
+}
+
+void BasicMainWindow::onPlayerVolumeChanged()
+{
+	m->update_scheduler.post(PlayerState::VolumeDirty);
+}
+
+void BasicMainWindow::onElapsedTick()
+{
+	m->update_scheduler.post(PlayerState::ElapsedDirty);
+}
+
+void BasicMainWindow::onFlushUpdates(unsigned int dirty)
 {
-	doUpdateStatus();
+	doUpdateStatus(dirty);
+}
+
+// 隠れている間、状態は MPD の idle で待つ。表示に戻ったら元の間隔ですぐに再開する
+void BasicMainWindow::onWindowVisibilityChanged(bool visible)
+{
+	m->status_thread.setIdleMode(!visible);
+	updateClockTimer();
+	if (visible && m->clock_timer_id != 0) {
+		tick();
+	}
+}
+
+void BasicMainWindow::onSleepTimerExpired()
+{
+	if (isPlaying() && m->sleep_time.isValid()) {
+		m->sleep_time = QDateTime();
+		pause();
+	}
+}
+
+void BasicMainWindow::onAlbumArtReady(QString const &path, QImage const &image)
+{
+	if (path == m->albumart_file) {
+		displayAlbumArt(image);
+	}
 }
 
 
@@ -1,9 +1,11 @@
 #ifndef BASICMAINWINDOW_H
 #define BASICMAINWINDOW_H
 
+#include <QImage>
 #include <QMainWindow>
 #include <QEvent>
 #include "MusicPlayerClient.h"
+#include "PlayerState.h"
 
 class Host;
 class Command;
@@ -11,13 +13,6 @@ class QToolButton;
 class QListWidget;
 class QComboBox;
 
-enum class PlayingStatus {
-	Unknown,
-	Stop,
-	Play,
-	Pause,
-};
-
 class BasicMainWindow : public QMainWindow {
 	Q_OBJECT
 	friend class EditPlaylistDialog;
@@ -29,12 +24,14 @@ protected:
 	void releaseMouseIfGrabbed();
 	void stopSleepTimer();
 	void stopStatusThread();
+	void startLibrarySync();
+	void stopLibrarySync();
 	void execSleepTimerDialog();
 
 	int currentPlaylistCount();
 	static QString textForExport(const MusicPlayerClient::Item &item);
 
-	void updatePlayingStatus();
+	void updatePlayingStatus(unsigned int dirty = PlayerState::AllDirty);
 	virtual void updateServersComboBox() {}
 	virtual void setPageConnected() {}
 	virtual void updateTreeTopLevel() {}
@@ -54,12 +51,15 @@ protected:
 	virtual void updatePlayIcon() {}
 	virtual void updatePlaylist() {}
 	virtual void updateCurrentSongInfo() {}
+	virtual void displayAlbumArt(QImage const & /*image*/) {}
+	void updateAlbumArt();
 	void invalidateCurrentSongIndicator();
 	void displayProgress(double elapsed);
 
 	QString serverName() const;
 	void showNotify(const QString &text);
 	void showError(const QString &text);
+	void showAddFailure(QStringList const &failed);
 	void update(bool mpdupdate);
 	void checkDisconnected();
 	void execSongProperty(const QString &path, int listrow, bool addplaylist);
@@ -69,10 +69,13 @@ protected:
 	void doQuickSave2();
 	void doQuickLoad1();
 	void doQuickLoad2();
-	virtual void doUpdateStatus();
+	virtual void doUpdateStatus(unsigned int dirty);
 	void updatePlayIcon(PlayingStatus status, QToolButton *button, QAction *action);
 	virtual void displayExtraInformation(const QString &text2, const QString &text3) = 0;
 	void timerEvent(QTimerEvent *);
+	void tick();
+	void checkAlive();
+	void updateClockTimer();
 	static void updatePlaylist(QListWidget *listwidget, QList<MusicPlayerClient::Item> *items);
 	static void makeServersComboBox(QComboBox *cbox, const QString &firstitem, const Host &current_host);
 	void onServersComboBoxIndexChanged(QComboBox *cbox, int index);
@@ -106,7 +109,15 @@ public:
 	void addPlaylsitToPlaylist(QString const &path, int to);
 private slots:
 	void onVolumeChanged();
-	void onUpdateStatus();
+	void onStateChanged();
+	void onSongChanged();
+	void onOptionsChanged();
+	void onPlayerVolumeChanged();
+	void onElapsedTick();
+	void onFlushUpdates(unsigned int dirty);
+	void onWindowVisibilityChanged(bool visible);
+	void onSleepTimerExpired();
+	void onAlbumArtReady(QString const &path, QImage const &image);
 };
 
 enum {
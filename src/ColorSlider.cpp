@@ -1,5 +1,5 @@
 #include "ColorSlider.h"
-#include <functional>
+#include "ImageKernels.h"
 
 ColorSlider::ColorSlider(QWidget *parent)
 	: RingSlider(parent)
@@ -26,41 +26,16 @@ ColorSlider::ColorSlider(QWidget *parent)
 void ColorSlider::setColor(QColor const &color)
 {
 	color_ = color;
-	update();
+	invalidateCache();
 }
 
 QImage ColorSlider::generateSliderImage()
 {
-	int max = 255;//maximum();
-
-	std::function<QColor(int t)> color;
-
-	auto rgb_r = [&](int r){ return QColor(r, color_.green(), color_.blue()); };
-	auto rgb_g = [&](int g){ return QColor(color_.red(), g, color_.blue()); };
-	auto rgb_b = [&](int b){ return QColor(color_.red(), color_.green(), b); };
-	auto hsv_h = [&](int h){ return QColor::fromHsv(h, 255, 255); };
-	auto hsv_s = [&](int s){ return QColor::fromHsv(color_.hue(), s, color_.value()); };
-	auto hsv_v = [&](int v){ return QColor::fromHsv(color_.hue(), color_.saturation(), v); };
-	auto unknown = [&](int i){ return QColor(i, i, i); };
-
-//	switch (color_type_) {
-//	case RGB_R: color = rgb_r; break;
-//	case RGB_G: color = rgb_g; break;
-//	case RGB_B: color = rgb_b; break;
-//	case HSV_H: color = hsv_h; break;
-//	case HSV_S: color = hsv_s; break;
-//	case HSV_V: color = hsv_v; break;
-//	default: color = unknown; break;
-//	}
-	color = unknown;
-
 	int w = sliderImageSize().width();
-	QImage img(w, 1, QImage::Format_ARGB32);
-	for (int i = 0; i < w; i++) {
-		int t = i * (max + 1) / w;
-		reinterpret_cast<QRgb *>(img.scanLine(0))[i] = color(t).rgb();
-	}
+	int r = color_.red();
+	int g = color_.green();
+	int b = color_.blue();
 
-	return img;
+	// トラックの上に重ねるので、左端の透明から右端の半透明の color_ へ
+	return makeRampImage(w, qRgba(r, g, b, 0), qRgba(r, g, b, 128));
 }
-
@@ -0,0 +1,302 @@
+#include "CommandMetrics.h"
+
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct Stat {
+	std::atomic<quint64> count {0};
+	std::atomic<quint64> errors {0};
+	std::atomic<quint64> bytes_sent {0};
+	std::atomic<quint64> bytes_received {0};
+	std::atomic<quint64> total_ns {0};
+	std::atomic<quint64> ttfb_ns {0};
+	std::atomic<quint64> parse_ns {0};
+	std::atomic<quint64> max_ns {0};
+	std::atomic<quint64> buckets[CommandMetrics::Buckets];
+	Stat()
+	{
+		clear();
+	}
+	void clear()
+	{
+		count = 0;
+		errors = 0;
+		bytes_sent = 0;
+		bytes_received = 0;
+		total_ns = 0;
+		ttfb_ns = 0;
+		parse_ns = 0;
+		max_ns = 0;
+		for (auto &b : buckets) b = 0;
+	}
+};
+
+struct Shard {
+	std::atomic<unsigned int> generation {0}; // 持ち主が最後に値を消したときの Registry::generation
+	Stat stats[CommandMetrics::MaxCommands];
+};
+
+struct Registry {
+	QMutex mutex;
+	std::atomic<unsigned int> generation {0}; // reset() のたびに増える
+	std::vector<QString> names;
+	std::vector<std::unique_ptr<Shard>> shards;
+	std::vector<Shard *> free_shards; // 終了したスレッドの領域は次のスレッドが引き継ぐ
+	Registry()
+	{
+		names.push_back("(other)");
+	}
+};
+
+Registry *registry()
+{
+	static Registry r;
+	return &r;
+}
+
+struct ShardHolder {
+	Shard *shard;
+	ShardHolder()
+	{
+		Registry *r = registry();
+		QMutexLocker lock(&r->mutex);
+		if (r->free_shards.empty()) {
+			r->shards.emplace_back(new Shard());
+			shard = r->shards.back().get();
+		} else {
+			shard = r->free_shards.back();
+			r->free_shards.pop_back();
+		}
+	}
+	~ShardHolder()
+	{
+		Registry *r = registry();
+		QMutexLocker lock(&r->mutex);
+		r->free_shards.push_back(shard);
+	}
+};
+
+// reset() の後は、持ち主のスレッドが自分で値を消してから書く。
+// ほかのスレッドが書き換えると持ち主の書き込みと混ざり、回数とバケットが食い違う
+Stat *stat(int id)
+{
+	thread_local ShardHolder holder;
+	Shard *shard = holder.shard;
+	unsigned int gen = registry()->generation.load(std::memory_order_acquire);
+	if (shard->generation.load(std::memory_order_relaxed) != gen) {
+		for (Stat &s : shard->stats) {
+			s.clear();
+		}
+		shard->generation.store(gen, std::memory_order_release);
+	}
+	if (id < 0 || id >= CommandMetrics::MaxCommands) id = 0;
+	return &shard->stats[id];
+}
+
+inline void add(std::atomic<quint64> *v, quint64 n)
+{
+	v->store(v->load(std::memory_order_relaxed) + n, std::memory_order_relaxed); // 書くのは持ち主のスレッドだけ
+}
+
+int bucket(quint64 ns)
+{
+	quint64 us = ns / 1000;
+	int b = 0;
+	while (us > 0 && b < CommandMetrics::Buckets - 1) {
+		us >>= 1;
+		b++;
+	}
+	return b;
+}
+
+double percentile(quint64 const *buckets, double p)
+{
+	quint64 count = 0; // 記録中の値と混ざっても食い違わないよう、回数もバケットから数える
+	for (int i = 0; i < CommandMetrics::Buckets; i++) {
+		count += buckets[i];
+	}
+	if (count == 0) return 0;
+	quint64 target = (quint64)(count * p);
+	quint64 n = 0;
+	for (int i = 0; i < CommandMetrics::Buckets; i++) {
+		n += buckets[i];
+		if (n > target) {
+			return (i == 0 ? 1 : (double)(1ULL << i)) / 1000.0; // バケットの上限
+		}
+	}
+	return (double)(1ULL << (CommandMetrics::Buckets - 1)) / 1000.0;
+}
+
+}
+
+int CommandMetrics::commandId(QString const &command)
+{
+	int i = command.indexOf(' ');
+	int j = command.indexOf('\n');
+	if (i < 0 || (j >= 0 && j < i)) i = j;
+	QString name = i < 0 ? command : command.left(i);
+	if (name == "command_list_begin" || name == "command_list_ok_begin") {
+		name = "command_list";
+	}
+
+	thread_local std::map<QString, int> cache;
+	auto it = cache.find(name);
+	if (it != cache.end()) return it->second;
+
+	Registry *r = registry();
+	int id = 0;
+	{
+		QMutexLocker lock(&r->mutex);
+		for (size_t k = 0; k < r->names.size(); k++) {
+			if (r->names[k] == name) {
+				id = (int)k;
+				break;
+			}
+		}
+		if (id == 0 && r->names.size() < MaxCommands) {
+			id = (int)r->names.size();
+			r->names.push_back(name);
+		}
+	}
+	cache[name] = id;
+	return id;
+}
+
+CommandMetrics::Sample::Sample(QString const &command)
+	: id(commandId(command))
+{
+	timer_.start();
+}
+
+void CommandMetrics::Sample::firstByte()
+{
+	if (first_byte_ns_ < 0) {
+		first_byte_ns_ = timer_.nsecsElapsed();
+	}
+}
+
+void CommandMetrics::Sample::finish(bool ok)
+{
+	quint64 ns = (quint64)timer_.nsecsElapsed();
+	Stat *s = stat(id);
+	add(&s->count, 1);
+	if (!ok) add(&s->errors, 1);
+	add(&s->bytes_sent, (quint64)bytes_sent);
+	add(&s->bytes_received, (quint64)bytes_received);
+	add(&s->total_ns, ns);
+	add(&s->ttfb_ns, (quint64)(first_byte_ns_ < 0 ? ns : first_byte_ns_));
+	add(&s->buckets[bucket(ns)], 1);
+	if (ns > s->max_ns.load(std::memory_order_relaxed)) {
+		s->max_ns.store(ns, std::memory_order_relaxed);
+	}
+}
+
+CommandMetrics::ParseTimer::ParseTimer(int id)
+	: id_(id)
+{
+	timer_.start();
+}
+
+CommandMetrics::ParseTimer::~ParseTimer()
+{
+	add(&stat(id_)->parse_ns, (quint64)timer_.nsecsElapsed());
+}
+
+QList<CommandMetrics::Summary> CommandMetrics::snapshot()
+{
+	Registry *r = registry();
+	QMutexLocker lock(&r->mutex);
+	QList<Summary> list;
+	for (size_t id = 0; id < r->names.size(); id++) {
+		Summary sum;
+		sum.command = r->names[id];
+		quint64 buckets[Buckets] = {};
+		quint64 total = 0, ttfb = 0, parse = 0, max = 0;
+		unsigned int gen = r->generation.load(std::memory_order_relaxed);
+		for (auto const &shard : r->shards) {
+			if (shard->generation.load(std::memory_order_acquire) != gen) continue; // reset() 後にまだ書いていない
+			Stat const &s = shard->stats[id];
+			sum.count += s.count.load(std::memory_order_relaxed);
+			sum.errors += s.errors.load(std::memory_order_relaxed);
+			sum.bytes_sent += s.bytes_sent.load(std::memory_order_relaxed);
+			sum.bytes_received += s.bytes_received.load(std::memory_order_relaxed);
+			total += s.total_ns.load(std::memory_order_relaxed);
+			ttfb += s.ttfb_ns.load(std::memory_order_relaxed);
+			parse += s.parse_ns.load(std::memory_order_relaxed);
+			max = std::max(max, (quint64)s.max_ns.load(std::memory_order_relaxed));
+			for (int b = 0; b < Buckets; b++) {
+				buckets[b] += s.buckets[b].load(std::memory_order_relaxed);
+			}
+		}
+		if (sum.count == 0) continue;
+		sum.avg_ms = total / 1e6 / sum.count;
+		sum.ttfb_ms = ttfb / 1e6 / sum.count;
+		sum.parse_ms = parse / 1e6 / sum.count;
+		sum.max_ms = max / 1e6;
+		sum.p50_ms = percentile(buckets, 0.50);
+		sum.p90_ms = percentile(buckets, 0.90);
+		sum.p99_ms = percentile(buckets, 0.99);
+		list.push_back(sum);
+	}
+	return list;
+}
+
+// 値を消すのは各シャードの持ち主に任せ、ここでは世代を進めるだけにする
+void CommandMetrics::reset()
+{
+	Registry *r = registry();
+	QMutexLocker lock(&r->mutex);
+	r->generation.fetch_add(1, std::memory_order_release);
+}
+
+QByteArray CommandMetrics::toJson(QList<Summary> const &list)
+{
+	QJsonArray commands;
+	for (Summary const &s : list) {
+		QJsonObject o;
+		o["command"] = s.command;
+		o["count"] = (double)s.count;
+		o["errors"] = (double)s.errors;
+		o["bytes_sent"] = (double)s.bytes_sent;
+		o["bytes_received"] = (double)s.bytes_received;
+		o["avg_ms"] = s.avg_ms;
+		o["ttfb_ms"] = s.ttfb_ms;
+		o["parse_ms"] = s.parse_ms;
+		o["p50_ms"] = s.p50_ms;
+		o["p90_ms"] = s.p90_ms;
+		o["p99_ms"] = s.p99_ms;
+		o["max_ms"] = s.max_ms;
+		commands.append(o);
+	}
+	QJsonObject root;
+	root["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+	root["commands"] = commands;
+	return QJsonDocument(root).toJson();
+}
+
+QByteArray CommandMetrics::toCsv(QList<Summary> const &list)
+{
+	QByteArray out = "time,command,count,errors,bytes_sent,bytes_received,avg_ms,ttfb_ms,parse_ms,p50_ms,p90_ms,p99_ms,max_ms\n";
+	QByteArray time = QDateTime::currentDateTimeUtc().toString(Qt::ISODate).toUtf8();
+	for (Summary const &s : list) {
+		out += time + ',' + s.command.toUtf8();
+		for (quint64 v : { s.count, s.errors, s.bytes_sent, s.bytes_received }) {
+			out += ',' + QByteArray::number(v);
+		}
+		for (double v : { s.avg_ms, s.ttfb_ms, s.parse_ms, s.p50_ms, s.p90_ms, s.p99_ms, s.max_ms }) {
+			out += ',' + QByteArray::number(v, 'f', 3);
+		}
+		out += '\n';
+	}
+	return out;
+}
@@ -0,0 +1,57 @@
+#ifndef COMMANDMETRICS_H
+#define COMMANDMETRICS_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+// MPD コマンドごとの所要時間と転送量。
+// 記録はスレッドごとの領域に relaxed atomic で書くだけなので、ロックを取らない（ロックするのは初めて見るコマンド名の登録時だけ）。
+class CommandMetrics {
+public:
+	enum {
+		MaxCommands = 128,
+		Buckets = 32, // 2 の累乗のマイクロ秒ごと
+	};
+	struct Summary {
+		QString command;
+		quint64 count = 0;
+		quint64 errors = 0;
+		quint64 bytes_sent = 0;
+		quint64 bytes_received = 0;
+		double avg_ms = 0; // 以下は 1 回あたりの平均
+		double ttfb_ms = 0; // 送信から最初の応答が届くまで (time to first byte)
+		double parse_ms = 0;
+		double p50_ms = 0;
+		double p90_ms = 0;
+		double p99_ms = 0;
+		double max_ms = 0;
+	};
+	class Sample {
+	private:
+		QElapsedTimer timer_;
+		qint64 first_byte_ns_ = -1;
+	public:
+		int id;
+		qint64 bytes_sent = 0;
+		qint64 bytes_received = 0;
+		Sample(QString const &command);
+		void firstByte();
+		void finish(bool ok);
+	};
+	class ParseTimer {
+	private:
+		int id_;
+		QElapsedTimer timer_;
+	public:
+		ParseTimer(int id);
+		~ParseTimer();
+	};
+	static int commandId(QString const &command);
+	static QList<Summary> snapshot();
+	static void reset();
+	static QByteArray toJson(QList<Summary> const &list);
+	static QByteArray toCsv(QList<Summary> const &list);
+};
+
+#endif // COMMANDMETRICS_H
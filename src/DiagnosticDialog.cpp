@@ -1,8 +1,12 @@
 #include "DiagnosticDialog.h"
 #include "ui_DiagnosticDialog.h"
+#include "CommandMetrics.h"
+#include "ProtocolTrace.h"
+#include <QApplication>
 #include <QFileDialog>
 #include "MainWindow.h"
 #include <QFile>
+#include <algorithm>
 #include <string>
 
 DiagnosticDialog::DiagnosticDialog(QWidget *parent) :
@@ -13,6 +17,18 @@ DiagnosticDialog::DiagnosticDialog(QWidget *parent) :
 	auto flags = windowFlags();
 	flags &= ~Qt::WindowContextHelpButtonHint;
 	setWindowFlags(flags);
+
+	QStringList cols;
+	cols << tr("Command") << tr("Count") << tr("Errors") << tr("Avg (ms)") << tr("TTFB (ms)") << tr("Parse (ms)") << "p50" << "p90" << "p99" << tr("Max (ms)") << tr("Sent") << tr("Received");
+	ui->tableWidget->setColumnCount(cols.size());
+	ui->tableWidget->setHorizontalHeaderLabels(cols);
+
+	// 開いている間は 1 秒ごとに最新の値を表示する
+	connect(&timer, SIGNAL(timeout()), this, SLOT(updateMetrics()));
+	timer.start(1000);
+	updateMetrics();
+
+	ui->pushButton_trace->setChecked(ProtocolTrace::isRecording());
 }
 
 DiagnosticDialog::~DiagnosticDialog()
@@ -37,9 +53,71 @@ void DiagnosticDialog::setText(QString const &text)
 	ui->textEdit->setPlainText(text);
 }
 
+void DiagnosticDialog::updateMetrics()
+{
+	QList<CommandMetrics::Summary> list = CommandMetrics::snapshot();
+	std::sort(list.begin(), list.end(), [](CommandMetrics::Summary const &l, CommandMetrics::Summary const &r){
+		return l.avg_ms * l.count > r.avg_ms * r.count; // 平均と回数から求めた合計時間の長い順
+	});
+	ui->tableWidget->setUpdatesEnabled(false);
+	ui->tableWidget->setRowCount(list.size());
+	for (int row = 0; row < list.size(); row++) {
+		CommandMetrics::Summary const &s = list[row];
+		auto ms = [](double v){ return QString::number(v, 'f', 2); };
+		QStringList texts;
+		texts << s.command << QString::number(s.count) << QString::number(s.errors) << ms(s.avg_ms) << ms(s.ttfb_ms) << ms(s.parse_ms) << ms(s.p50_ms) << ms(s.p90_ms) << ms(s.p99_ms) << ms(s.max_ms) << QString::number(s.bytes_sent) << QString::number(s.bytes_received);
+		for (int col = 0; col < texts.size(); col++) {
+			QTableWidgetItem *item = ui->tableWidget->item(row, col);
+			if (!item) {
+				item = new QTableWidgetItem();
+				if (col > 0) item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+				ui->tableWidget->setItem(row, col, item);
+			}
+			item->setText(texts[col]);
+		}
+	}
+	ui->tableWidget->setUpdatesEnabled(true);
+}
+
+void DiagnosticDialog::on_pushButton_export_clicked()
+{
+	QString filter;
+	QString path = QFileDialog::getSaveFileName(this, qApp->applicationName(), "metrics.json", "JSON (*.json);;CSV (*.csv)", &filter);
+	if (path.isEmpty()) return;
+
+	QList<CommandMetrics::Summary> list = CommandMetrics::snapshot();
+	bool csv = path.endsWith(".csv", Qt::CaseInsensitive) || filter.startsWith("CSV");
+	QByteArray data = csv ? CommandMetrics::toCsv(list) : CommandMetrics::toJson(list);
+
+	QFile file(path);
+	if (file.open(QFile::WriteOnly | QFile::Truncate)) {
+		file.write(data);
+		file.close();
+	}
+}
+
+void DiagnosticDialog::on_pushButton_reset_clicked()
+{
+	CommandMetrics::reset();
+	updateMetrics();
+}
+
+// 記録はダイアログを閉じても続く。もう一度押すまで止めない
+void DiagnosticDialog::on_pushButton_trace_clicked(bool checked)
+{
+	if (checked) {
+		QString path = QFileDialog::getSaveFileName(this, qApp->applicationName(), "protocol.trace", "Protocol trace (*.trace)");
+		if (path.isEmpty() || !ProtocolTrace::start(path)) {
+			ui->pushButton_trace->setChecked(false);
+		}
+	} else {
+		ProtocolTrace::stop();
+	}
+}
+
 void DiagnosticDialog::on_pushButton_saveas_clicked()
 {
-	QString path = QFileDialog::getSaveFileName(the_mainwindow, qApp->applicationName(), "diagnostic.txt", "Text files (*.txx)");
+	QString path = QFileDialog::getSaveFileName(this, qApp->applicationName(), "diagnostic.txt", "Text files (*.txt)");
 	if (path.isEmpty()) return;
 
 	QFile file(path);
@@ -2,6 +2,7 @@
 #define DIAGNOSTICDIALOG_H
 
 #include <QDialog>
+#include <QTimer>
 
 namespace Ui {
 class DiagnosticDialog;
@@ -22,9 +23,14 @@ protected:
 
 private slots:
 	void on_pushButton_saveas_clicked();
+	void on_pushButton_export_clicked();
+	void on_pushButton_reset_clicked();
+	void on_pushButton_trace_clicked(bool checked);
+	void updateMetrics();
 
 private:
 	Ui::DiagnosticDialog *ui;
+	QTimer timer;
 };
 
 #endif // DIAGNOSTICDIALOG_H
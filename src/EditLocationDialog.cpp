@@ -2,8 +2,10 @@
 #include "ui_EditLocationDialog.h"
 #include "LocationLineEdit.h"
 #include "MainWindow.h"
+#include "PlaylistResolver.h"
 #include "SelectLocationDialog.h"
 #include <QDesktopServices>
+#include <QEventLoop>
 #include <QMessageBox>
 #include <QObjectUserData>
 #include <QUrl>
@@ -77,59 +79,82 @@ void EditLocationDialog::getLocations(QWidget *parent, const std::vector<Playlis
 	}
 }
 
-void EditLocationDialog::getLocations(QWidget *parent, const QString &loc, QStringList *out)
+void EditLocationDialog::setBusy(bool busy)
+{
+	ui->lineEdit->setEnabled(!busy);
+	ui->comboBox->setEnabled(!busy);
+	ui->pushButton_ok->setEnabled(!busy);
+	if (busy) {
+		QApplication::setOverrideCursor(Qt::BusyCursor);
+	} else {
+		QApplication::restoreOverrideCursor();
+	}
+}
+
+bool EditLocationDialog::resolve(QStringList const &locs, PlaylistResolver *resolver)
+{
+	QEventLoop loop;
+	connect(resolver, SIGNAL(finished()), &loop, SLOT(quit()));
+	resolver->setLocations(locs);
+	resolving = resolver;
+	setBusy(true);
+	resolver->start(); // プレイリストの取得と解析はUIスレッドの外で行う
+	loop.exec(); // 待っている間もキャンセルボタンは reject() で受け付ける
+	resolver->wait();
+	setBusy(false);
+	resolving = nullptr;
+	return resolver->isExpanded();
+}
+
+bool EditLocationDialog::getLocations(QStringList const &locs, QStringList *out)
 {
 	out->clear();
-	PlaylistFile playlist;
-	if (playlist.parse(loc)) {
-		auto const *locations = playlist.locations();
+	PlaylistResolver resolver;
+	bool expanded = resolve(locs, &resolver);
+	if (cancelled) {
+		return false;
+	}
+	if (expanded) {
+		auto const *locations = resolver.items();
 		if (!locations->empty()) {
-			getLocations(parent, locations, out);
+			getLocations(this, locations, out);
 		} else {
-			QMessageBox::warning(parent, qApp->applicationName(), tr("The playlist does not contain a valid item."));
+			QMessageBox::warning(this, qApp->applicationName(), tr("The playlist does not contain a valid item."));
 		}
 	} else {
-		out->push_back(loc);
+		*out = locs;
 	}
+	return true;
 }
 
 void EditLocationDialog::accept()
 {
 	QString loc = location();
-	if (loc.startsWith("http://")) {
+	if (loc.startsWith("http://") || loc.startsWith("https://")) {
 		QStringList list = loc.split(' ', QString::SkipEmptyParts);
-		if (list.size() == 1) {
-			loc = list[0];
-			getLocations(this, loc, &list);
-			bool ret = false;
-			QString newtext;
-			if (list.isEmpty()) {
-				newtext = loc; // revert to old text
-				ret = true;
-			} else if (list.size() == 1) {
-				if (list[0] == loc) {
-					// nop (normally return)
-				} else {
-					newtext = list[0];
-					ret = true;
-				}
-			} else if (list.size() > 1) {
-				for (QString const &loc : list) {
-					if (newtext.isEmpty()) {
-						newtext + ' ';
-					}
-					newtext += loc;
-				}
-				ret = true;
-			}
-			if (ret) {
-				ui->lineEdit->setText(newtext);
-				return;
-			}
+		QStringList newlist;
+		if (!getLocations(list, &newlist)) {
+			QDialog::reject();
+			return;
+		}
+		if (newlist.isEmpty()) {
+			ui->lineEdit->setText(loc); // revert to old text
+			return;
+		}
+		if (newlist != list) {
+			ui->lineEdit->setText(newlist.join(' '));
+			return;
 		}
 	}
 	QDialog::accept();
 }
 
-
-
+void EditLocationDialog::reject()
+{
+	if (resolving) { // 取得中なら中断させる。ダイアログは getLocations() から閉じる
+		cancelled = true;
+		resolving->cancel();
+		return;
+	}
+	QDialog::reject();
+}
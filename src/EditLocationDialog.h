@@ -3,6 +3,8 @@
 
 #include "PlaylistFile.h"
 
+class PlaylistResolver;
+
 #include <QDialog>
 
 namespace Ui {
@@ -25,12 +27,18 @@ private slots:
 
 private:
 	Ui::EditLocationDialog *ui;
+	PlaylistResolver *resolving = nullptr;
+	bool cancelled = false;
+
+	void setBusy(bool busy);
+	bool resolve(QStringList const &locs, PlaylistResolver *resolver);
 
 	// QDialog interface
 	static void getLocations(QWidget *parent, const std::vector<PlaylistFile::Item> *locations, QStringList *out);
-	static void getLocations(QWidget *parent, const QString &loc, QStringList *out);
+	bool getLocations(QStringList const &locs, QStringList *out);
 public slots:
 	void accept();
+	void reject();
 };
 
 #endif // EDITLOCATIONDIALOG_H
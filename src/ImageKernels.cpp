@@ -0,0 +1,123 @@
+#include "ImageKernels.h"
+
+#include <stdint.h>
+
+#ifndef USE_SIMD
+#define USE_SIMD 1
+#endif
+
+#if USE_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define IMAGEKERNELS_SSE2
+#include <emmintrin.h>
+#elif USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define IMAGEKERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+void fillSpan(QRgb *dst, int n, QRgb color)
+{
+	int i = 0;
+#if defined(IMAGEKERNELS_SSE2)
+	__m128i px = _mm_set1_epi32((int)color);
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_si128((__m128i *)(dst + i), px);
+	}
+#elif defined(IMAGEKERNELS_NEON)
+	uint32x4_t px = vdupq_n_u32(color);
+	for (; i + 4 <= n; i += 4) {
+		vst1q_u32(dst + i, px);
+	}
+#endif
+	for (; i < n; i++) {
+		dst[i] = color;
+	}
+}
+
+// 各チャンネルを 16.16 固定小数点で進める。どの経路でも結果は同じになる
+void fillLinearRamp(QRgb *dst, int n, QRgb from, QRgb to)
+{
+	if (n < 1) return;
+
+	static int const shift[4] = { 24, 16, 8, 0 };
+	int32_t base[4];
+	int32_t step[4];
+	for (int c = 0; c < 4; c++) {
+		int a = (from >> shift[c]) & 0xff;
+		int b = (to >> shift[c]) & 0xff;
+		base[c] = (a << 16) + 0x8000;
+		step[c] = n > 1 ? (b - a) * 65536 / (n - 1) : 0;
+	}
+
+	int i = 0;
+#if defined(IMAGEKERNELS_SSE2)
+	__m128i acc[4];
+	__m128i inc[4];
+	for (int c = 0; c < 4; c++) {
+		acc[c] = _mm_setr_epi32(base[c], base[c] + step[c], base[c] + step[c] * 2, base[c] + step[c] * 3);
+		inc[c] = _mm_set1_epi32(step[c] * 4);
+	}
+	for (; i + 4 <= n; i += 4) {
+		__m128i px = _mm_slli_epi32(_mm_srli_epi32(acc[0], 16), 24);
+		px = _mm_or_si128(px, _mm_slli_epi32(_mm_srli_epi32(acc[1], 16), 16));
+		px = _mm_or_si128(px, _mm_slli_epi32(_mm_srli_epi32(acc[2], 16), 8));
+		px = _mm_or_si128(px, _mm_srli_epi32(acc[3], 16));
+		_mm_storeu_si128((__m128i *)(dst + i), px);
+		for (int c = 0; c < 4; c++) {
+			acc[c] = _mm_add_epi32(acc[c], inc[c]);
+		}
+	}
+#elif defined(IMAGEKERNELS_NEON)
+	uint32x4_t acc[4];
+	uint32x4_t inc[4];
+	for (int c = 0; c < 4; c++) {
+		uint32_t v[4] = { (uint32_t)base[c], (uint32_t)(base[c] + step[c]), (uint32_t)(base[c] + step[c] * 2), (uint32_t)(base[c] + step[c] * 3) };
+		acc[c] = vld1q_u32(v);
+		inc[c] = vdupq_n_u32((uint32_t)(step[c] * 4));
+	}
+	for (; i + 4 <= n; i += 4) {
+		uint32x4_t px = vshlq_n_u32(vshrq_n_u32(acc[0], 16), 24);
+		px = vorrq_u32(px, vshlq_n_u32(vshrq_n_u32(acc[1], 16), 16));
+		px = vorrq_u32(px, vshlq_n_u32(vshrq_n_u32(acc[2], 16), 8));
+		px = vorrq_u32(px, vshrq_n_u32(acc[3], 16));
+		vst1q_u32(dst + i, px);
+		for (int c = 0; c < 4; c++) {
+			acc[c] = vaddq_u32(acc[c], inc[c]);
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		QRgb px = 0;
+		for (int c = 0; c < 4; c++) {
+			px |= (QRgb)((base[c] + step[c] * i) >> 16) << shift[c];
+		}
+		dst[i] = px;
+	}
+}
+
+QImage makeRampImage(int w, QRgb from, QRgb to)
+{
+	if (w < 1) return QImage();
+	QImage img(w, 1, QImage::Format_ARGB32);
+	fillLinearRamp(reinterpret_cast<QRgb *>(img.scanLine(0)), w, from, to);
+	return img;
+}
+
+QImage makeWedgeImage(int w, int h, QRgb color)
+{
+	if (w < 1 || h < 1) return QImage();
+	QImage img(w, h, QImage::Format_ARGB32_Premultiplied);
+	QRgb fg = qPremultiply(color);
+	for (int y = 0; y < h; y++) {
+		QRgb *dst = reinterpret_cast<QRgb *>(img.scanLine(y));
+		// 列 i の高さは (h - 1) * i / w + 1 で、最下行は使わない
+		int x = w;
+		if (h > 1 && y < h - 1) {
+			int k = h - 2 - y;
+			x = k > 0 ? (k * w + h - 2) / (h - 1) : 0;
+			if (x > w) x = w;
+		}
+		fillSpan(dst, x, 0);
+		fillSpan(dst + x, w - x, fg);
+	}
+	return img;
+}
@@ -0,0 +1,15 @@
+#ifndef IMAGEKERNELS_H
+#define IMAGEKERNELS_H
+
+#include <QImage>
+
+// ARGB32 の走査線を埋める画像カーネル。SSE2/NEON が使えればそれで、なければスカラーで処理する
+// DEFINES += USE_SIMD=0 でスカラー版だけになる
+
+void fillSpan(QRgb *dst, int n, QRgb color);
+void fillLinearRamp(QRgb *dst, int n, QRgb from, QRgb to); // 両端を含む線形補間
+
+QImage makeRampImage(int w, QRgb from, QRgb to);
+QImage makeWedgeImage(int w, int h, QRgb color); // 右上がりの三角形。左端の高さ 1 から右端の h - 1 まで
+
+#endif // IMAGEKERNELS_H
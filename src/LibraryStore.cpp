@@ -0,0 +1,104 @@
+#include "LibraryStore.h"
+
+void LibraryStore::clear()
+{
+	QMutexLocker lock(&mutex_);
+	partitions_.clear();
+}
+
+// ルート直下のものは空の名前のパーティションに入る
+QString LibraryStore::partitionOf(QString const &path)
+{
+	int i = path.indexOf('/');
+	return i < 0 ? QString() : path.left(i);
+}
+
+void LibraryStore::replacePartition(QString const &dir, Items const &items)
+{
+	Partition part;
+	part.items = items;
+	for (int i = 0; i < items.size(); i++) {
+		if (items[i].kind == "file") {
+			part.files.insert(items[i].text, i);
+		}
+	}
+	QMutexLocker lock(&mutex_);
+	partitions_[dir] = std::move(part);
+}
+
+void LibraryStore::retainPartitions(std::set<QString> const &dirs)
+{
+	QMutexLocker lock(&mutex_);
+	auto it = partitions_.begin();
+	while (it != partitions_.end()) {
+		if (dirs.find(it->first) == dirs.end()) {
+			it = partitions_.erase(it);
+		} else {
+			it++;
+		}
+	}
+}
+
+bool LibraryStore::hasPartition(QString const &dir) const
+{
+	QMutexLocker lock(&mutex_);
+	return partitions_.find(dir) != partitions_.end();
+}
+
+QStringList LibraryStore::partitionNames() const
+{
+	QMutexLocker lock(&mutex_);
+	QStringList list;
+	for (auto const &pair : partitions_) {
+		list.push_back(pair.first);
+	}
+	return list;
+}
+
+LibraryStore::Items LibraryStore::partition(QString const &dir) const
+{
+	QMutexLocker lock(&mutex_);
+	auto it = partitions_.find(dir);
+	if (it != partitions_.end()) {
+		return it->second.items;
+	}
+	return Items();
+}
+
+bool LibraryStore::find(QString const &file, MusicPlayerClient::Item *out) const
+{
+	QMutexLocker lock(&mutex_);
+	auto it = partitions_.find(partitionOf(file));
+	if (it != partitions_.end()) {
+		auto f = it->second.files.find(file);
+		if (f != it->second.files.end()) {
+			*out = it->second.items[f.value()];
+			return true;
+		}
+	}
+	return false;
+}
+
+LibraryStore::Items LibraryStore::items() const
+{
+	QMutexLocker lock(&mutex_);
+	Items vec;
+	for (auto const &pair : partitions_) {
+		vec.append(pair.second.items);
+	}
+	return vec;
+}
+
+int LibraryStore::songCount() const
+{
+	QMutexLocker lock(&mutex_);
+	int count = 0;
+	for (auto const &pair : partitions_) {
+		for (MusicPlayerClient::Item const &item : pair.second.items) {
+			if (item.kind == "file") {
+				count++;
+			}
+		}
+	}
+	return count;
+}
@@ -0,0 +1,35 @@
+#ifndef LIBRARYSTORE_H
+#define LIBRARYSTORE_H
+
+#include "MusicPlayerClient.h"
+
+#include <QHash>
+#include <QMutex>
+#include <map>
+#include <set>
+
+// ローカルに保持する楽曲ライブラリ。トップレベルディレクトリ単位（パーティション）で管理する。
+class LibraryStore {
+public:
+	using Items = QList<MusicPlayerClient::Item>;
+private:
+	struct Partition {
+		Items items;
+		QHash<QString, int> files; // file のパスから items の位置を引く
+	};
+	mutable QMutex mutex_;
+	std::map<QString, Partition> partitions_;
+public:
+	static QString partitionOf(QString const &path);
+	void clear();
+	void replacePartition(QString const &dir, Items const &items);
+	void retainPartitions(std::set<QString> const &dirs);
+	bool hasPartition(QString const &dir) const;
+	QStringList partitionNames() const;
+	Items partition(QString const &dir) const;
+	bool find(QString const &file, MusicPlayerClient::Item *out) const;
+	Items items() const;
+	int songCount() const;
+};
+
+#endif // LIBRARYSTORE_H
@@ -0,0 +1,265 @@
+#include "LibrarySyncThread.h"
+
+#ifdef WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+
+#include <QMutex>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <set>
+
+struct LibrarySyncThread::Private {
+	QMutex mutex;
+	Host host;
+	LibraryStore *store = nullptr;
+	int worker_count = 4;
+	int retry_count = 2;
+	std::deque<QString> queue;
+	QStringList failed;
+	int done = 0;
+	int total = 0;
+	std::set<qintptr> sockets; // cancel() で止めるための、各スレッドが使用中のソケット
+};
+
+class LibrarySyncThread::Worker : public QThread {
+private:
+	LibrarySyncThread *owner;
+protected:
+	void run()
+	{
+		MusicPlayerClient mpc;
+		if (!mpc.open(owner->pv->host)) {
+			return;
+		}
+		owner->addSocket(&mpc);
+		QString dir;
+		while (!owner->isInterruptionRequested() && owner->takePartition(&dir)) {
+			QList<MusicPlayerClient::Item> items;
+			if (mpc.do_listallinfo(dir, &items) && owner->storePartition(dir, items)) {
+				owner->finishPartition(dir, true);
+			} else {
+				owner->finishPartition(dir, false);
+				if (owner->isInterruptionRequested()) break;
+				if (!mpc.ping(1)) { // 接続が切れていたらつなぎ直す
+					owner->removeSocket(&mpc);
+					mpc.close();
+					if (!mpc.open(owner->pv->host)) {
+						break;
+					}
+					owner->addSocket(&mpc);
+				}
+			}
+		}
+		owner->removeSocket(&mpc);
+		mpc.close();
+	}
+public:
+	Worker(LibrarySyncThread *owner)
+		: owner(owner)
+	{
+	}
+};
+
+LibrarySyncThread::LibrarySyncThread()
+{
+	pv = new Private();
+}
+
+LibrarySyncThread::~LibrarySyncThread()
+{
+	requestInterruption();
+	wait();
+	delete pv;
+}
+
+void LibrarySyncThread::setHost(Host const &host)
+{
+	pv->host = host;
+}
+
+void LibrarySyncThread::setStore(LibraryStore *store)
+{
+	pv->store = store;
+}
+
+void LibrarySyncThread::setWorkerCount(int n)
+{
+	pv->worker_count = n < 1 ? 1 : n;
+}
+
+void LibrarySyncThread::setRetryCount(int n)
+{
+	pv->retry_count = n < 0 ? 0 : n;
+}
+
+// UI スレッドから呼ぶ。待たずに戻る。
+// 以後ストアには書き込まず、応答待ちのソケットは切断して listallinfo の途中でもすぐに終わらせる
+void LibrarySyncThread::cancel()
+{
+	requestInterruption();
+	QMutexLocker lock(&pv->mutex);
+	pv->store = nullptr;
+	for (qintptr fd : pv->sockets) {
+#ifdef WIN32
+		::shutdown((SOCKET)fd, SD_BOTH);
+#else
+		::shutdown((int)fd, SHUT_RDWR);
+#endif
+	}
+}
+
+void LibrarySyncThread::addSocket(MusicPlayerClient const *mpc)
+{
+	qintptr fd = mpc->socketDescriptor();
+	if (fd == -1) return;
+	QMutexLocker lock(&pv->mutex);
+	pv->sockets.insert(fd);
+}
+
+void LibrarySyncThread::removeSocket(MusicPlayerClient const *mpc)
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->sockets.erase(mpc->socketDescriptor());
+}
+
+// 取り消されていたら書き込まずに false を返す
+bool LibrarySyncThread::storePartition(QString const &dir, LibraryStore::Items const &items)
+{
+	QMutexLocker lock(&pv->mutex);
+	if (!pv->store || isInterruptionRequested()) {
+		return false;
+	}
+	pv->store->replacePartition(dir, items);
+	return true;
+}
+
+QStringList LibrarySyncThread::failedPartitions() const
+{
+	QMutexLocker lock(&pv->mutex);
+	return pv->failed;
+}
+
+bool LibrarySyncThread::takePartition(QString *out)
+{
+	QMutexLocker lock(&pv->mutex);
+	if (pv->queue.empty()) {
+		return false;
+	}
+	*out = pv->queue.front();
+	pv->queue.pop_front();
+	return true;
+}
+
+void LibrarySyncThread::finishPartition(QString const &dir, bool ok)
+{
+	int done, total;
+	{
+		QMutexLocker lock(&pv->mutex);
+		if (ok) {
+			pv->done++;
+		} else {
+			pv->failed.push_back(dir);
+		}
+		done = pv->done;
+		total = pv->total;
+	}
+	if (ok) {
+		emit progress(done, total);
+	}
+}
+
+void LibrarySyncThread::run()
+{
+	{
+		QMutexLocker lock(&pv->mutex);
+		if (!pv->store) {
+			lock.unlock();
+			emit synchronized(false);
+			return;
+		}
+	}
+
+	QList<MusicPlayerClient::Item> toplevel;
+	{
+		MusicPlayerClient mpc;
+		bool ok = mpc.open(pv->host);
+		if (ok) {
+			addSocket(&mpc);
+			ok = !isInterruptionRequested() && mpc.do_lsinfo(QString(), &toplevel);
+			removeSocket(&mpc);
+			mpc.close();
+		}
+		if (!ok) {
+			emit synchronized(false);
+			return;
+		}
+	}
+
+	std::set<QString> dirs;
+	{
+		QMutexLocker lock(&pv->mutex);
+		if (!pv->store || isInterruptionRequested()) {
+			lock.unlock();
+			emit synchronized(false);
+			return;
+		}
+		pv->queue.clear();
+		pv->failed.clear();
+		LibraryStore::Items rootitems; // ルート直下のファイルやプレイリストは lsinfo の結果をそのまま使う
+		for (MusicPlayerClient::Item const &item : toplevel) {
+			if (item.kind == "directory") {
+				dirs.insert(item.text);
+				pv->queue.push_back(item.text);
+			} else {
+				rootitems.push_back(item);
+			}
+		}
+		dirs.insert(QString());
+		pv->store->replacePartition(QString(), rootitems);
+		pv->store->retainPartitions(dirs); // サーバから消えたディレクトリを捨てる
+		pv->done = 0;
+		pv->total = (int)pv->queue.size();
+	}
+	emit progress(0, pv->total);
+
+	for (int attempt = 0; attempt <= pv->retry_count; attempt++) {
+		int n;
+		{
+			QMutexLocker lock(&pv->mutex);
+			if (attempt > 0) { // 失敗したパーティションだけやり直す
+				for (QString const &dir : pv->failed) {
+					pv->queue.push_back(dir);
+				}
+				pv->failed.clear();
+			}
+			n = std::min(pv->worker_count, (int)pv->queue.size());
+		}
+		if (n < 1 || isInterruptionRequested()) break;
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		for (int i = 0; i < n; i++) {
+			workers.emplace_back(new Worker(this));
+			workers.back()->start();
+		}
+		for (auto &worker : workers) {
+			worker->wait();
+		}
+
+		QMutexLocker lock(&pv->mutex);
+		while (!pv->queue.empty()) { // 接続できずに取り残されたもの
+			pv->failed.push_back(pv->queue.front());
+			pv->queue.pop_front();
+		}
+	}
+
+	bool success;
+	{
+		QMutexLocker lock(&pv->mutex);
+		success = pv->failed.isEmpty() && !isInterruptionRequested();
+	}
+	emit synchronized(success);
+}
@@ -0,0 +1,37 @@
+#ifndef LIBRARYSYNCTHREAD_H
+#define LIBRARYSYNCTHREAD_H
+
+#include "LibraryStore.h"
+
+#include <QThread>
+
+
+// トップレベルディレクトリごとに listallinfo を複数の接続で並列に実行し、LibraryStore に取り込む。
+class LibrarySyncThread : public QThread {
+	Q_OBJECT
+private:
+	class Worker;
+	struct Private;
+	Private *pv;
+	bool takePartition(QString *out);
+	void finishPartition(QString const &dir, bool ok);
+	bool storePartition(QString const &dir, LibraryStore::Items const &items);
+	void addSocket(MusicPlayerClient const *mpc);
+	void removeSocket(MusicPlayerClient const *mpc);
+protected:
+	void run();
+public:
+	LibrarySyncThread();
+	~LibrarySyncThread();
+	void setHost(Host const &host);
+	void setStore(LibraryStore *store);
+	void setWorkerCount(int n);
+	void setRetryCount(int n);
+	void cancel();
+	QStringList failedPartitions() const;
+signals:
+	void progress(int done, int total);
+	void synchronized(bool success);
+};
+
+#endif // LIBRARYSYNCTHREAD_H
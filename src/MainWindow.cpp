@@ -4,6 +4,7 @@
 #include "BasicMainWindow.h"
 #include "Common.h"
 #include "ConnectionDialog.h"
+#include "DiagnosticDialog.h"
 #include "EditLocationDialog.h"
 #include "EditPlaylistDialog.h"
 #include "main.h"
@@ -68,6 +69,8 @@ MainWindow::MainWindow(QWidget *parent) :
 	QFormLayout *layout = static_cast<QFormLayout *>(ui->widget_information_area->layout());
 	layout->setLabelAlignment(Qt::AlignLeft | Qt::AlignVCenter);
 
+	m->albumart_thread.setImageSize(ui->label_albumart->maximumSize() * devicePixelRatio());
+
 #if 0 //def Q_OS_WIN
 	priv->folder_icon = QIcon(":/image/winfolder.png");
 #else
@@ -575,6 +578,16 @@ void MainWindow::seekProgressSlider(double elapsed, double total)
 	ui->horizontalSlider->blockSignals(b);
 }
 
+void MainWindow::displayAlbumArt(QImage const &image)
+{
+	QPixmap pm;
+	if (!image.isNull()) {
+		pm = QPixmap::fromImage(image);
+		pm.setDevicePixelRatio(devicePixelRatio());
+	}
+	ui->label_albumart->setPixmap(pm);
+}
+
 void MainWindow::displayCurrentSongLabels(QString const &title, QString const &artist, QString const &disc)
 {
 	ui->label_title->setText(title);
@@ -648,10 +661,12 @@ void MainWindow::updateTreeTopLevel()
 	}
 }
 
-void MainWindow::doUpdateStatus()
+void MainWindow::doUpdateStatus(unsigned int dirty)
 {
-	if (!ui->horizontalSlider->isSliderDown()) {
-		BasicMainWindow::doUpdateStatus();
+	m->status_dirty |= dirty;
+	if (!ui->horizontalSlider->isSliderDown()) { // スライダー操作中に溜まった変化はまとめて反映する
+		BasicMainWindow::doUpdateStatus(m->status_dirty);
+		m->status_dirty = 0;
 	}
 }
 
@@ -697,7 +712,11 @@ void MainWindow::updateTree(ResultItem *info)
 					QString path = mpcitem.text;
 					QString text;
 					QList<MusicPlayerClient::Item> v;
-					if (mpc()->do_listallinfo(path, &v)) {
+					MusicPlayerClient::Item cached;
+					if (m->library.find(path, &cached)) { // 同期済みのライブラリにあればサーバに問い合わせない
+						v.push_back(cached);
+					}
+					if (!v.isEmpty() || mpc()->do_listallinfo(path, &v)) {
 						if (v.size() == 1) {
 							MusicPlayerClient::StringMap const &map = v.front().map;
 							int trk = map.get("Track").toInt();
@@ -1179,6 +1198,16 @@ void MainWindow::on_action_help_about_triggered()
 	dlg.exec();
 }
 
+void MainWindow::on_action_help_diagnostic_triggered()
+{
+	DiagnosticDialog dlg(this);
+	QString text;
+	text += tr("Server: ") + m->host.address() + ':' + QString::number(m->host.port(DEFAULT_MPD_PORT)) + '\n';
+	text += tr("Connected: ") + (m->connected ? "yes" : "no") + '\n';
+	dlg.setText(text);
+	dlg.exec();
+}
+
 void MainWindow::on_action_play_triggered()
 {
 	play(true);
@@ -38,6 +38,7 @@ private:
 	void on_edit_location();
 	void displayProgress(const QString &text);
 	void seekProgressSlider(double elapsed, double total);
+	void displayAlbumArt(QImage const &image);
 	static bool isRoot(QTreeWidgetItem *item);
 	static bool isFolder(QTreeWidgetItem *item);
 	static bool isFile(QTreeWidgetItem *item);
@@ -77,7 +78,7 @@ protected:
 	void updatePlayIcon();
 	void updatePlaylist();
 	void updateTreeTopLevel();
-	void doUpdateStatus();
+	void doUpdateStatus(unsigned int dirty);
 	void displayExtraInformation(const QString &text2, const QString &text3);
 	void execConnectionDialog();
 private slots:
@@ -90,6 +91,7 @@ private slots:
 	void on_action_edit_paste_insert_triggered();
 	void on_action_file_close_triggered();
 	void on_action_help_about_triggered();
+	void on_action_help_diagnostic_triggered();
 	void on_action_network_connect_triggered();
 	void on_action_network_disconnect_triggered();
 	void on_action_network_reconnect_triggered();
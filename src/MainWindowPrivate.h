@@ -5,7 +5,12 @@
 #include "VerticalVolumePopup.h"
 #include "VolumeIndicatorPopup.h"
 #include "StatusThread.h"
+#include "LibraryStore.h"
+#include "LibrarySyncThread.h"
+#include "AlbumArtThread.h"
+#include "AlbumArtCache.h"
 #include "StatusLabel.h"
+#include "UpdateScheduler.h"
 #include "main.h"
 #include <QTimer>
 #include <QWaitCondition>
@@ -38,6 +43,11 @@ struct BasicMainWindow::Private {
 	bool connected = false;
 	MusicPlayerClient mpc;
 	StatusThread status_thread;
+	LibraryStore library;
+	LibrarySyncThread *library_sync = nullptr;
+	AlbumArtCache albumart_cache;
+	AlbumArtThread albumart_thread;
+	QString albumart_file;
 	Host host;
 	std::vector<SongItem> drop_before;
 	struct Playing {
@@ -47,6 +57,7 @@ struct BasicMainWindow::Private {
 			QString title;
 			QString artist;
 			QString disc;
+			QString file;
 			int track = 0;
 			bool operator == (Status const &r) const
 			{
@@ -56,6 +67,7 @@ struct BasicMainWindow::Private {
 						title == r.title &&
 						artist == r.artist &&
 						disc == r.disc &&
+						file == r.file &&
 						track == r.track
 						;
 			}
@@ -71,6 +83,13 @@ struct BasicMainWindow::Private {
 	bool consume_enabled = false;
 	bool random_enabled = false;
 	int volume = -1;
+	int next_song = -1;
+	unsigned int status_dirty = 0;
+	UpdateScheduler update_scheduler;
+	bool clock_enabled = false;
+	int clock_timer_id = 0;
+	int liveness_timer_id = 0; // ウィンドウが隠れている間だけ使う
+	QTimer sleep_timer; // ウィンドウが隠れている間だけ使う
 	VerticalVolumePopup volume_popup;
 
 	QMenu menu;
@@ -1,5 +1,8 @@
 #include "MusicPlayerClient.h"
+#include "ProtocolTrace.h"
 #include <QHostAddress>
+#include <algorithm>
+#include <deque>
 
 
 void Host::set(const QString &hostname, int port)
@@ -42,45 +45,119 @@ bool MusicPlayerClient::isValidPlaylistName(const QString &name)
 	return true;
 }
 
-bool MusicPlayerClient::recv(QTcpSocket *sock, QStringList *lines)
+static qint64 const MAX_BINARY_SIZE = 64 * 1024 * 1024; // binarylimit の上限より十分大きく、len + 1 があふれない値
+
+static bool read_bytes(QIODevice *sock, qint64 len, QByteArray *out)
+{
+	while (sock->bytesAvailable() < len) {
+		if (!sock->waitForReadyRead(10000)) {
+			return false;
+		}
+	}
+	*out = sock->read(len);
+	return true;
+}
+
+bool MusicPlayerClient::recv(QIODevice *sock, QStringList *lines, QByteArray *binary, CommandMetrics::Sample *sample)
 {
 	int timeout = 10000;
-	while (sock->waitForReadyRead(timeout)) {
-		while (sock->canReadLine()) {
-			QByteArray ba = sock->readLine();
-			QString s;
-			int n = ba.size();
-			if (n > 0) {
-				char const *p = ba.data();
-				if (n > 0 && p[n - 1] == '\n') {
-					n--;
-				}
-				if (n > 0) {
-					s = QString::fromUtf8(p, n);
-				}
+	while (1) {
+		if (!sock->canReadLine()) {
+			if (!sock->waitForReadyRead(timeout)) {
+				break;
 			}
-			if (s == "OK") {
-				return true;
+			timeout = 1000;
+			continue;
+		}
+		QByteArray ba = sock->readLine();
+		if (sample) {
+			sample->firstByte();
+			sample->bytes_received += ba.size();
+		}
+		if (trace_response_) {
+			trace_response_->append(ba);
+		}
+		QString s;
+		int n = ba.size();
+		if (n > 0) {
+			char const *p = ba.data();
+			if (n > 0 && p[n - 1] == '\n') {
+				n--;
 			}
-			lines->push_back(s);
-			if (s.startsWith("ACK")) {
-				int i = s.indexOf('}');
-				if (i > 0) {
-					ushort const *p = s.utf16();
-					do {
-						i++;
-					} while (QChar(p[i]).isSpace());
-					exception = s.mid(i);
+			if (n > 0) {
+				s = QString::fromUtf8(p, n);
+			}
+		}
+		if (s == "OK") {
+			return true;
+		}
+		lines->push_back(s);
+		if (s.startsWith("ACK")) {
+			int i = s.indexOf('}');
+			if (i > 0) {
+				i++;
+				while (i < s.size() && s[i].isSpace()) {
+					i++;
 				}
+				exception = s.mid(i);
+			}
+			return false;
+		}
+		if (binary && s.startsWith("binary: ")) { // 続く N バイトはバイナリデータ、その後に改行が一つ
+			qint64 len = s.mid(8).toLongLong();
+			QByteArray data;
+			if (len < 0 || len > MAX_BINARY_SIZE || !read_bytes(sock, len + 1, &data)) {
 				return false;
 			}
+			if (sample) {
+				sample->bytes_received += data.size();
+			}
+			if (trace_response_) {
+				trace_response_->append(data);
+			}
+			data.chop(1);
+			binary->append(data);
 		}
-		timeout = 1000;
 	}
 	return false;
 }
 
-bool MusicPlayerClient::exec(QString const &command, QStringList *lines)
+// コマンドを送る。記録中なら送った時刻を控えておく
+bool MusicPlayerClient::send_exchange(Exchange *x)
+{
+	x->traced = ProtocolTrace::isRecording();
+	if (x->traced) {
+		if (trace_connection_ == 0) {
+			trace_connection_ = ProtocolTrace::newConnectionId();
+		}
+		x->sent_ns = ProtocolTrace::now();
+	}
+	QByteArray ba = x->command + '\n';
+	x->sample.bytes_sent = sock().write(ba.data(), ba.size());
+	return x->sample.bytes_sent == ba.size();
+}
+
+bool MusicPlayerClient::recv_exchange(Exchange *x, QStringList *lines, QByteArray *binary)
+{
+	trace_response_ = x->traced ? &x->response : nullptr;
+	bool ok = recv(&sock(), lines, binary, &x->sample);
+	trace_response_ = nullptr;
+	end_exchange(x, ok);
+	return ok;
+}
+
+void MusicPlayerClient::end_exchange(Exchange *x, bool ok)
+{
+	x->sample.finish(ok);
+	if (x->traced) {
+		if (x->command.startsWith("password ")) { // パスワードは残さない
+			x->command = "password \"*\"";
+		}
+		ProtocolTrace::record(trace_connection_, x->sent_ns, x->command, x->response);
+	}
+}
+
+bool MusicPlayerClient::exec(QString const &command, QStringList *lines, QByteArray *binary)
 {
 	lines->clear();
 	exception.clear();
@@ -89,10 +166,43 @@ bool MusicPlayerClient::exec(QString const &command, QStringList *lines)
 		sock().readAll();
 	}
 
-	QByteArray ba = (command + '\n').toUtf8();
-	sock().write(ba.data(), ba.size());
-
-	return recv(&sock(), lines);
+	Exchange x(command);
+	send_exchange(&x);
+	bool ok = recv_exchange(&x, lines, binary);
+	last_command_ = x.sample.id;
+	return ok;
+}
+
+// command_list で送り、往復を一回で済ませる。大きすぎるリストはサーバに拒否されるので分ける。
+// サーバは失敗したコマンドより後を実行しないので、ACK が返ったら *failed にその位置を返す。それ以外の失敗なら -1
+bool MusicPlayerClient::exec_command_list(QStringList const &commands, int *failed)
+{
+	if (failed) *failed = -1;
+	int const chunk = 1000;
+	for (int i = 0; i < commands.size(); i += chunk) {
+		QString cmd = "command_list_begin\n";
+		int n = std::min(chunk, commands.size() - i);
+		for (int j = 0; j < n; j++) {
+			cmd += commands[i + j];
+			cmd += '\n';
+		}
+		cmd += "command_list_end";
+		QStringList lines;
+		if (!exec(cmd, &lines)) {
+			if (failed && !lines.isEmpty() && lines.back().startsWith("ACK [")) { // ACK [error@command_listNum] {command} message
+				QString const &s = lines.back();
+				int at = s.indexOf('@');
+				int end = s.indexOf(']');
+				bool ok = false;
+				int index = at > 0 && at < end ? s.mid(at + 1, end - at - 1).toInt(&ok) : -1;
+				if (ok && index >= 0 && index < n) {
+					*failed = i + index;
+				}
+			}
+			return false;
+		}
+	}
+	return true;
 }
 
 MusicPlayerClient::OpenResult MusicPlayerClient::open(QTcpSocket *sock, Host const &host, Logger *logger)
@@ -193,6 +303,7 @@ bool MusicPlayerClient::ping(int retry)
 
 void MusicPlayerClient::parse_result(QStringList const &lines, QList<Item> *out)
 {
+	CommandMetrics::ParseTimer timer(last_command_);
 	Item info;
 	auto it = lines.begin();
 	while (1) {
@@ -211,6 +322,9 @@ void MusicPlayerClient::parse_result(QStringList const &lines, QList<Item> *out)
 			it++;
 		}
 		bool low = QChar(key.utf16()[0]).isLower();
+		if (low && info.kind == "file" && key != "file" && key != "directory" && key != "playlist") {
+			low = false; // 新しい MPD は duration: や format: のような小文字の属性も送ってくる
+		}
 		if (low || end) {
 			if (!info.kind.isEmpty() || !info.map.empty()) {
 				out->push_back(info);
@@ -233,6 +347,7 @@ void MusicPlayerClient::parse_result(QStringList const &lines, QList<Item> *out)
 
 void MusicPlayerClient::parse_result(QStringList const &lines, std::vector<KeyValue> *out)
 {
+	CommandMetrics::ParseTimer timer(last_command_);
 	out->clear();
 	auto it = lines.begin();
 	while (1) {
@@ -256,11 +371,13 @@ void MusicPlayerClient::parse_result(QStringList const &lines, std::vector<KeyVa
 
 void MusicPlayerClient::parse_result(QStringList const &lines, StringMap *out)
 {
+	CommandMetrics::ParseTimer timer(last_command_); // 他の parse_result を呼ぶと解析時間が二重に数えられる
 	out->clear();
-	std::vector<KeyValue> vec;
-	parse_result(lines, &vec);
-	for (KeyValue const &item : vec) {
-		out->map[item.key] = item.value;
+	for (QString const &line : lines) {
+		int i = line.indexOf(':');
+		if (i > 0) {
+			out->map[line.mid(0, i)] = line.mid(i + 1).trimmed();
+		}
 	}
 }
 
@@ -394,6 +511,16 @@ bool MusicPlayerClient::do_deleteid(int id)
 	return exec(QString("delete ") + QString::number(id), &lines);
 }
 
+// こちらは playlistinfo の Id で指定する。位置と違って途中で消してもずれない
+bool MusicPlayerClient::do_deleteid(QList<int> const &ids)
+{
+	QStringList cmds;
+	for (int id : ids) {
+		cmds.push_back(QString("deleteid ") + QString::number(id));
+	}
+	return exec_command_list(cmds);
+}
+
 bool MusicPlayerClient::do_move(int from, int to)
 {
 	QStringList lines;
@@ -406,6 +533,50 @@ bool MusicPlayerClient::do_swap(int a, int b)
 	return exec(QString("swap ") + QString::number(a) + ' ' + QString::number(b), &lines);
 }
 
+// まとめて追加する。to が負なら末尾に追加する。
+// 一つ失敗すると command_list の残りは実行されないので、失敗したものを *failed に入れて飛ばし、残りを送り直す
+bool MusicPlayerClient::add_(QStringList const &paths, int to, QStringList *failed)
+{
+	bool ok = true;
+	int i = 0;
+	while (i < paths.size()) {
+		QStringList cmds;
+		int n = std::min(1000, paths.size() - i); // 失敗のたびに作り直すので一度に送る数を抑える
+		for (int j = 0; j < n; j++) {
+			if (to < 0) {
+				cmds.push_back(QString("add \"") + paths[i + j] + "\"");
+			} else {
+				cmds.push_back(QString("addid \"") + paths[i + j] + "\" " + QString::number(to + j));
+			}
+		}
+		int index = -1;
+		if (exec_command_list(cmds, &index)) {
+			i += n;
+			if (to >= 0) to += n;
+			continue;
+		}
+		ok = false;
+		if (index < 0) { // 接続の問題なので、残りも送れない
+			if (failed) failed->append(paths.mid(i));
+			break;
+		}
+		if (failed) failed->push_back(paths[i + index]);
+		if (to >= 0) to += index;
+		i += index + 1;
+	}
+	return ok;
+}
+
+bool MusicPlayerClient::do_add(QStringList const &paths, QStringList *failed)
+{
+	return add_(paths, -1, failed);
+}
+
+bool MusicPlayerClient::do_addid(QStringList const &paths, int to, QStringList *failed)
+{
+	return add_(paths, to, failed);
+}
+
 int MusicPlayerClient::do_addid(QString const &path, int to)
 {
 	QStringList lines;
@@ -550,6 +721,136 @@ bool MusicPlayerClient::do_update()
 	return exec("update", &lines);
 }
 
+// 専用の関数がないコマンドをそのまま送る。応答は解析せずに返す
+bool MusicPlayerClient::do_command(QString const &command, QStringList *lines)
+{
+	return exec(command, lines);
+}
+
+// idle は応答を待たずに送っておき、wait_idle で変化を待つ。途中でやめるときは do_noidle を送る
+bool MusicPlayerClient::do_idle(QString const &subsystems)
+{
+	exception.clear();
+
+	if (sock().waitForReadyRead(0)) {
+		sock().readAll();
+	}
+
+	QString cmd = "idle";
+	if (!subsystems.isEmpty()) {
+		cmd += ' ' + subsystems;
+	}
+	idle_ = QSharedPointer<Exchange>(new Exchange(cmd)); // 応答が届いたときに記録する
+	if (!send_exchange(idle_.data())) {
+		idle_.reset();
+		return false;
+	}
+	sock().flush();
+	return true;
+}
+
+static void parse_changed(QStringList const &lines, QStringList *changed)
+{
+	if (!changed) return;
+	changed->clear();
+	for (QString const &line : lines) {
+		if (line.startsWith("changed: ")) {
+			changed->push_back(line.mid(9));
+		}
+	}
+}
+
+// 変化があれば 1、timeout ms 待っても何もなければ 0、接続が切れていれば -1
+int MusicPlayerClient::wait_idle(int timeout, QStringList *changed)
+{
+	if (!sock().canReadLine() && !sock().waitForReadyRead(timeout)) {
+		return sock().state() == QAbstractSocket::ConnectedState ? 0 : -1;
+	}
+	QStringList lines;
+	QSharedPointer<Exchange> x = idle_;
+	idle_.reset();
+	if (!(x ? recv_exchange(x.data(), &lines) : recv(&sock(), &lines))) {
+		return -1;
+	}
+	parse_changed(lines, changed);
+	return 1;
+}
+
+// idle がすでに応答していれば noidle は無視されるので、どちらの場合も応答は一つだけ
+// noidle 自身には応答がないので、空の応答として記録する
+bool MusicPlayerClient::do_noidle(QStringList *changed)
+{
+	Exchange noidle("noidle");
+	end_exchange(&noidle, send_exchange(&noidle));
+	QStringList lines;
+	QSharedPointer<Exchange> x = idle_;
+	idle_.reset();
+	if (!(x ? recv_exchange(x.data(), &lines) : recv(&sock(), &lines))) {
+		return false;
+	}
+	parse_changed(lines, changed);
+	return true;
+}
+
+bool MusicPlayerClient::fetch_picture(QString const &command, QString const &path, QByteArray *out)
+{
+	out->clear();
+	QString cmd = command + " \"" + path + "\" ";
+	QStringList lines;
+	QByteArray chunk;
+	if (!exec(cmd + '0', &lines, &chunk)) {
+		return false;
+	}
+	StringMap map;
+	parse_result(lines, &map);
+	qint64 size = map.get("size").toLongLong();
+	if (size <= 0 || chunk.isEmpty()) { // 画像がないという答え。通信の失敗とは区別する
+		return true;
+	}
+	out->reserve(size);
+	out->append(chunk);
+
+	// 残りのチャンクは応答を待たずに複数の要求を送っておき、届いた順に受け取る。計測と記録は要求ごとに行う
+	const int depth = 4;
+	const int chunk_size = chunk.size();
+	std::deque<std::pair<qint64, Exchange>> inflight;
+	qint64 requested = out->size();
+	while (out->size() < size) {
+		while ((int)inflight.size() < depth && requested < size) {
+			inflight.emplace_back(requested, Exchange(cmd + QString::number(requested)));
+			send_exchange(&inflight.back().second);
+			requested += chunk_size;
+		}
+		lines.clear();
+		chunk.clear();
+		bool ok = recv_exchange(&inflight.front().second, &lines, &chunk);
+		qint64 offset = inflight.front().first;
+		inflight.pop_front();
+		if (!ok || chunk.isEmpty() || offset != out->size()) {
+			while (!inflight.empty()) { // 送ってしまった要求の応答を読み捨てる
+				lines.clear();
+				chunk.clear();
+				recv_exchange(&inflight.front().second, &lines, &chunk);
+				inflight.pop_front();
+			}
+			out->clear();
+			return false;
+		}
+		out->append(chunk);
+	}
+	return true;
+}
+
+bool MusicPlayerClient::do_albumart(QString const &path, QByteArray *out)
+{
+	return fetch_picture("albumart", path, out);
+}
+
+bool MusicPlayerClient::do_readpicture(QString const &path, QByteArray *out)
+{
+	return fetch_picture("readpicture", path, out);
+}
+
 int MusicPlayerClient::current_playlist_file_count()
 {
 	QStringList lines;
@@ -7,6 +7,7 @@
 #include <map>
 #include <QSharedPointer>
 #include "misc.h"
+#include "CommandMetrics.h"
 
 #define DEFAULT_MPD_PORT 6600
 
@@ -71,6 +72,7 @@ public:
 
 class MusicPlayerClient : public QObject {
 	Q_OBJECT
+	friend struct ParserHarness;
 public:
 	struct KeyValue {
 		QString key;
@@ -138,14 +140,37 @@ private:
 		return sock_.isNull() ? nullptr : &*sock_;
 	}
 	QString exception;
+	int last_command_ = 0; // 解析時間をどのコマンドに計上するか
+	quint64 trace_connection_ = 0; // ProtocolTrace の接続番号
+	QByteArray *trace_response_ = nullptr; // 記録中なら受信したバイト列をそのまま貯める
+	// 送ったコマンド一つ分の計測と記録。応答を待たずに次を送るときは、送った数だけ持っておく
+	struct Exchange {
+		CommandMetrics::Sample sample;
+		QByteArray command;
+		bool traced = false;
+		quint64 sent_ns = 0;
+		QByteArray response;
+		Exchange(QString const &command)
+			: sample(command)
+			, command(command.toUtf8())
+		{
+		}
+	};
+	QSharedPointer<Exchange> idle_; // 応答を待っている idle
 private:
-	bool recv(QTcpSocket *sock, QStringList *lines);
-	bool exec(QString const &command, QStringList *lines);
+	bool recv(QIODevice *sock, QStringList *lines, QByteArray *binary = nullptr, CommandMetrics::Sample *sample = nullptr);
+	bool send_exchange(Exchange *x);
+	bool recv_exchange(Exchange *x, QStringList *lines, QByteArray *binary = nullptr);
+	void end_exchange(Exchange *x, bool ok);
+	bool exec(QString const &command, QStringList *lines, QByteArray *binary = nullptr);
+	bool exec_command_list(QStringList const &commands, int *failed = nullptr);
+	bool add_(QStringList const &paths, int to, QStringList *failed);
 	void parse_result(QStringList const &lines, QList<Item> *out);
 	void parse_result(QStringList const &lines, std::vector<KeyValue> *out);
 	void parse_result(QStringList const &lines, StringMap *out);
 	template <typename T> bool info_(QString const &command, QString const &path, T *out);
 	bool send_password(QString const &password);
+	bool fetch_picture(QString const &command, QString const &path, QByteArray *out);
 public:
 	MusicPlayerClient();
 	MusicPlayerClient(MusicPlayerClient const &) = delete;
@@ -164,6 +189,10 @@ public:
 	bool open(Host const &host);
 	void close();
 	bool isOpen() const;
+	qintptr socketDescriptor() const
+	{
+		return sock_.isNull() ? -1 : sock_->socketDescriptor();
+	}
 	bool ping(int retry = 3);
 	bool do_status(StringMap *out);
 	bool do_lsinfo(QString const &path, QList<Item> *out);
@@ -175,7 +204,10 @@ public:
 	bool do_playlist(QList<Item> *out);
 	bool do_playlistinfo(QString const &path, QList<Item> *out);
 	bool do_add(QString const &path);
+	bool do_add(QStringList const &paths, QStringList *failed = nullptr);
+	bool do_addid(QStringList const &paths, int to, QStringList *failed = nullptr);
 	bool do_deleteid(int id);
+	bool do_deleteid(QList<int> const &ids);
 	bool do_move(int from, int to);
 	bool do_swap(int a, int b);
 	int do_addid(QString const &path, int to);
@@ -197,6 +229,12 @@ public:
 	bool do_rename(QString const &curname, QString const &newname);
 	bool do_rm(QString const &name);
 	bool do_update();
+	bool do_command(QString const &command, QStringList *lines);
+	bool do_idle(QString const &subsystems);
+	int wait_idle(int timeout, QStringList *changed);
+	bool do_noidle(QStringList *changed);
+	bool do_albumart(QString const &path, QByteArray *out);
+	bool do_readpicture(QString const &path, QByteArray *out);
 	int get_volume();
 
 	static void sort(QList<MusicPlayerClient::Item> *vec);
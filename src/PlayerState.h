@@ -0,0 +1,79 @@
+#ifndef PLAYERSTATE_H
+#define PLAYERSTATE_H
+
+#include <QString>
+#include <memory>
+
+enum class PlayingStatus {
+	Unknown,
+	Stop,
+	Play,
+	Pause,
+};
+
+// StatusThread が解析済みの状態を公開するための不変のスナップショット
+struct PlayerState {
+	enum Dirty {
+		StateDirty = 0x01,
+		SongDirty = 0x02,
+		OptionsDirty = 0x04,
+		VolumeDirty = 0x08,
+		ElapsedDirty = 0x10,
+		AllDirty = 0xff,
+	};
+	struct Song {
+		bool valid = false; // status の songid と currentsong の Id が一致している
+		int id = -1;
+		QString file;
+		QString title;
+		QString artist;
+		QString album;
+		int track = 0;
+	};
+	bool valid = false; // status が取得できた
+	PlayingStatus status = PlayingStatus::Stop;
+	int song = -1;
+	int songid = -1;
+	int nextsong = -1;
+	int volume = -1;
+	bool repeat = false;
+	bool single = false;
+	bool consume = false;
+	bool random = false;
+	double elapsed = 0;
+	double total = 0;
+	unsigned int playlist = 0;
+	Song current;
+	unsigned int dirty = AllDirty; // 直前の状態から変化した項目
+	static unsigned int diff(PlayerState const &l, PlayerState const &r)
+	{
+		unsigned int dirty = 0;
+		if (l.valid != r.valid || l.status != r.status) {
+			dirty |= StateDirty;
+		}
+		if (l.song != r.song || l.songid != r.songid || l.nextsong != r.nextsong ||
+				l.current.valid != r.current.valid ||
+				l.current.id != r.current.id ||
+				l.current.file != r.current.file ||
+				l.current.title != r.current.title ||
+				l.current.artist != r.current.artist ||
+				l.current.album != r.current.album ||
+				l.current.track != r.current.track) {
+			dirty |= SongDirty;
+		}
+		if (l.repeat != r.repeat || l.single != r.single || l.consume != r.consume || l.random != r.random) {
+			dirty |= OptionsDirty;
+		}
+		if (l.volume != r.volume) {
+			dirty |= VolumeDirty;
+		}
+		if ((int)l.elapsed != (int)r.elapsed || l.total != r.total) { // 表示は秒単位なので端数の変化は無視する
+			dirty |= ElapsedDirty;
+		}
+		return dirty;
+	}
+};
+
+using PlayerStatePtr = std::shared_ptr<PlayerState const>;
+
+#endif // PLAYERSTATE_H
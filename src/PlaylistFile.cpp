@@ -1,111 +1,269 @@
+#include "ApplicationGlobal.h"
 #include "MemoryReader.h"
 #include "PlaylistFile.h"
+#include "StreamProbe.h"
+#include "pathcat.h"
 #include "webclient.h"
 
 #include <QBuffer>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUrl>
 #include <QXmlStreamReader>
+#include <algorithm>
+#include <climits>
+#include <ctype.h>
+#include <string.h>
+
+namespace {
+
+// [begin,end) を一行ずつ切り出す。前後の空白と CR は取り除く
+class LineScanner {
+private:
+	char const *ptr;
+	char const *end;
+public:
+	LineScanner(char const *begin, char const *end)
+		: ptr(begin)
+		, end(end)
+	{
+	}
+	bool next(char const **left, char const **right)
+	{
+		if (ptr >= end) return false;
+		char const *nl = (char const *)memchr(ptr, '\n', end - ptr);
+		char const *b = ptr;
+		char const *e = nl ? nl : end;
+		ptr = nl ? nl + 1 : end;
+		while (b < e && isspace(*b & 0xff)) b++;
+		while (b < e && isspace(e[-1] & 0xff)) e--;
+		*left = b;
+		*right = e;
+		return true;
+	}
+};
+
+inline bool starts_with(char const *left, char const *right, char const *key, bool ci)
+{
+	while (*key) {
+		if (left >= right) return false;
+		int a = *left & 0xff;
+		int b = *key & 0xff;
+		if (ci) {
+			a = tolower(a);
+			b = tolower(b);
+		}
+		if (a != b) return false;
+		left++;
+		key++;
+	}
+	return true;
+}
+
+inline bool equals(char const *left, char const *right, char const *key, bool ci)
+{
+	return (size_t)(right - left) == strlen(key) && starts_with(left, right, key, ci);
+}
+
+inline int to_int(char const *left, char const *right)
+{
+	while (left < right && isspace(*left & 0xff)) left++;
+	bool neg = false;
+	if (left < right && (*left == '-' || *left == '+')) {
+		neg = (*left == '-');
+		left++;
+	}
+	int n = 0;
+	while (left < right && isdigit(*left & 0xff)) {
+		int d = *left - '0';
+		if (n > (INT_MAX - d) / 10) { // 桁が多すぎるとあふれるので上限で止める
+			n = INT_MAX;
+			break;
+		}
+		n = n * 10 + d;
+		left++;
+	}
+	return neg ? -n : n;
+}
+
+inline QString decode(char const *left, char const *right)
+{
+	return QString::fromUtf8(left, int(right - left)).trimmed();
+}
+
+inline bool is_url(char const *left, char const *right)
+{
+	return starts_with(left, right, "http://", true) || starts_with(left, right, "https://", true);
+}
+
+}
 
 bool PlaylistFile::parse_pls(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
 {
 	out->clear();
-	MemoryReader in;
-	in.setData(begin, end - begin);
-	if (in.open(QBuffer::ReadOnly)) {
-		std::map<int, Item> songs;
-		bool valid = false;
-		QString File = "File";
-		QString Title = "Title";
-		QString Length = "Length";
-		while (!in.atEnd()) {
-			QString line = in.readLine().trimmed();
-			int eq = line.indexOf('=');
-			if (line.compare("[playlist]", Qt::CaseInsensitive) == 0) {
+	struct Entry {
+		int n;
+		int key; // 0: File, 1: Title, 2: Length
+		char const *left;
+		char const *right;
+	};
+	std::vector<Entry> entries; // FileN の N で並べる。N は飛び飛びでもよいので、行の数だけ持つ
+	bool valid = false;
+	LineScanner scanner(begin, end);
+	char const *left;
+	char const *right;
+	while (scanner.next(&left, &right)) {
+		if (!valid) {
+			if (equals(left, right, "[playlist]", true)) {
 				valid = true;
-			} else if (valid) {
-				if (line.startsWith(File, Qt::CaseInsensitive)) {
-					int i = File.size();
-					if (eq > i) {
-						int n = line.mid(i, eq - i).trimmed().toInt();
-						songs[n].file = line.mid(eq + 1).trimmed();
-					}
-				} else if (line.startsWith(Title, Qt::CaseInsensitive)) {
-					int i = Title.size();
-					if (eq > i) {
-						int n = line.mid(i, eq - i).trimmed().toInt();
-						songs[n].title = line.mid(eq + 1).trimmed();
-					}
-				} else if (line.startsWith(Length, Qt::CaseInsensitive)) {
-					int i = Length.size();
-					if (eq > i) {
-						int n = line.mid(i, eq - i).trimmed().toInt();
-						songs[n].length = line.mid(eq + 1).trimmed().toInt();
-					}
-				}
-			} else if (!line.isEmpty()) {
+			} else if (left < right) {
 				return false;
 			}
+			continue;
+		}
+		char const *eq = (char const *)memchr(left, '=', right - left);
+		if (!eq) continue;
+		int key;
+		char const *p;
+		if (starts_with(left, eq, "File", true)) {
+			key = 0;
+			p = left + 4;
+		} else if (starts_with(left, eq, "Title", true)) {
+			key = 1;
+			p = left + 5;
+		} else if (starts_with(left, eq, "Length", true)) {
+			key = 2;
+			p = left + 6;
+		} else {
+			continue;
 		}
-		for (auto pair : songs) {
-			Item const &item = pair.second;
-			if (item.file.startsWith("http")) {
-				out->push_back(item);
+		int n = to_int(p, eq);
+		if (n < 0) continue;
+		entries.push_back({ n, key, eq + 1, right });
+	}
+	if (!valid) return false;
+	// 同じ N の行は現れた順に当てはめるので、後に書かれた値が残る
+	std::stable_sort(entries.begin(), entries.end(), [](Entry const &a, Entry const &b){
+		return a.n < b.n;
+	});
+	size_t i = 0;
+	while (i < entries.size()) {
+		Item item;
+		int n = entries[i].n;
+		for (; i < entries.size() && entries[i].n == n; i++) {
+			Entry const &e = entries[i];
+			switch (e.key) {
+			case 0:
+				item.file = decode(e.left, e.right);
+				break;
+			case 1:
+				item.title = decode(e.left, e.right);
+				break;
+			case 2:
+				item.length = to_int(e.left, e.right);
+				break;
 			}
 		}
-		return true;
+		if (item.file.startsWith("http")) {
+			out->push_back(std::move(item));
+		}
 	}
-	return false;
+	return true;
+}
+
+// HLS の属性リスト（KEY=VALUE,KEY="VALUE"）から name の値を取り出す
+static QString hls_attribute(char const *left, char const *right, char const *name)
+{
+	size_t len = strlen(name);
+	char const *p = left;
+	while (p < right) {
+		while (p < right && (*p == ',' || isspace(*p & 0xff))) p++;
+		char const *key = p;
+		while (p < right && *p != '=' && *p != ',') p++;
+		bool match = ((size_t)(p - key) == len && starts_with(key, p, name, true));
+		if (p >= right || *p != '=') continue;
+		p++;
+		char const *val = p;
+		char const *valend;
+		if (p < right && *p == '"') {
+			val = ++p;
+			while (p < right && *p != '"') p++;
+			valend = p;
+			if (p < right) p++;
+		} else {
+			while (p < right && *p != ',') p++;
+			valend = p;
+		}
+		if (match) {
+			return decode(val, valend);
+		}
+	}
+	return QString();
 }
 
-bool PlaylistFile::parse_m3u(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
+bool PlaylistFile::parse_m3u(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out, QString const &base)
 {
 	out->clear();
-	MemoryReader in;
-	in.setData(begin, end - begin);
-	if (in.open(QBuffer::ReadOnly)) {
-		bool ext = false;
-		QString EXTINF = "#EXTINF";
-		while (!in.atEnd()) {
-			QString line = in.readLine().trimmed();
-			if (line.startsWith('#')) {
-				if (line.compare("#EXTM3U") == 0) {
-					ext = true;
-				} else {
-					// nop (comment)
+	Item song;
+	bool hls = false; // #EXT-X- があれば M3U8 (HLS) として相対 URI を受け付ける
+	bool variant = false;
+	bool media = false;
+	LineScanner scanner(begin, end);
+	char const *left;
+	char const *right;
+	while (scanner.next(&left, &right)) {
+		if (left == right) continue;
+		if (*left == '#') {
+			if (starts_with(left, right, "#EXTINF:", false)) { // #EXTINF:長さ,タイトル
+				char const *p = left + 8;
+				char const *comma = (char const *)memchr(p, ',', right - p);
+				song.length = to_int(p, comma ? comma : right);
+				if (song.length < 1) {
+					song.length = -1;
 				}
-			} else if (ext && line.startsWith(EXTINF)) {
-				Item song;
-				int i = EXTINF.size();
-				if (i < line.size()) {
-					int colon = line.indexOf(':', i);
-					if (colon > 0) {
-						int comma = line.indexOf(',', i);
-						QString length;
-						if (comma > colon) {
-							length = line.mid(colon + 1, (comma > colon) ? (comma - colon - 1) : -1);
-							song.title = line.mid(comma + 1);
-						} else {
-							length = line.mid(colon + 1);
-						}
-						song.length = length.trimmed().toInt();
-						if (song.length < 1) {
-							song.length = -1;
-						}
+				song.title = comma ? decode(comma + 1, right) : QString();
+			} else if (starts_with(left, right, "#EXT-X-STREAM-INF:", false)) { // マスタープレイリストの各ストリーム
+				hls = true;
+				variant = true;
+				char const *p = left + 18;
+				song.title = hls_attribute(p, right, "NAME");
+				if (song.title.isEmpty()) {
+					int bandwidth = hls_attribute(p, right, "BANDWIDTH").toInt();
+					if (bandwidth > 0) {
+						song.title = QString("%1 kbps").arg(bandwidth / 1000);
 					}
 				}
-				line = in.readLine();
-				song.file = line.trimmed();
-				out->push_back(song);
-			} else if (line.startsWith("http://")) {
-				Item song;
-				song.file = line;
-				out->push_back(song);
-			} else {
-				return false;
+			} else if (starts_with(left, right, "#EXT-X-TARGETDURATION", false) || starts_with(left, right, "#EXT-X-MEDIA-SEQUENCE", false)) {
+				hls = true;
+				media = true;
+			} else if (starts_with(left, right, "#EXT-X-", false)) {
+				hls = true;
 			}
+			continue; // それ以外はコメント
 		}
-		return true;
+		if (is_url(left, right)) {
+			song.file = decode(left, right);
+		} else if (hls && !base.isEmpty()) {
+			song.file = QUrl(base).resolved(QUrl(decode(left, right))).toString();
+		} else {
+			return false;
+		}
+		out->push_back(std::move(song));
+		song = Item();
 	}
-	return false;
+	if (hls && media && !variant) { // セグメントの一覧はそれ自体がひとつのストリーム
+		out->clear();
+		if (!base.isEmpty()) {
+			Item item;
+			item.file = base;
+			out->push_back(item);
+		}
+	}
+	return true;
 }
 
 bool PlaylistFile::parse_xspf(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
@@ -195,37 +353,292 @@ bool PlaylistFile::parse_xspf(char const *begin, char const *end, std::vector<Pl
 	return false;
 }
 
-class MyWebClientHandler : public WebClientHandler {
-public:
-	void checkHeader(WebClient *wc)
-	{
-		std::string ct = wc->content_type();
-		if (ct == "audio/mpeg") {
-			abort();
+static QString xml_unescape(QString s)
+{
+	if (s.indexOf('&') < 0) return s;
+	s.replace("&lt;", "<");
+	s.replace("&gt;", ">");
+	s.replace("&quot;", "\"");
+	s.replace("&apos;", "'");
+	s.replace("&amp;", "&");
+	return s;
+}
+
+// タグの中（<ref href="..."> の ref 以降）から属性の値を取り出す
+static QString tag_attribute(char const *left, char const *right, char const *name)
+{
+	size_t len = strlen(name);
+	char const *p = left;
+	while (p < right) {
+		while (p < right && !isalpha(*p & 0xff)) p++;
+		char const *key = p;
+		while (p < right && (isalnum(*p & 0xff) || *p == '-' || *p == '_')) p++;
+		bool match = ((size_t)(p - key) == len && starts_with(key, p, name, true));
+		while (p < right && isspace(*p & 0xff)) p++;
+		if (p >= right || *p != '=') continue;
+		p++;
+		while (p < right && isspace(*p & 0xff)) p++;
+		char const *val = p;
+		char const *valend;
+		if (p < right && (*p == '"' || *p == '\'')) {
+			char quote = *p;
+			val = ++p;
+			while (p < right && *p != quote) p++;
+			valend = p;
+			if (p < right) p++;
+		} else {
+			while (p < right && !isspace(*p & 0xff) && *p != '/') p++;
+			valend = p;
+		}
+		if (match) {
+			return xml_unescape(decode(val, valend));
 		}
 	}
-	void checkContent(const char *, size_t len)
-	{
-		if (len > 100000) {
-			abort();
+	return QString();
+}
+
+// ASX は整形式の XML でないことが多いので、タグを直接拾う
+bool PlaylistFile::parse_asx(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
+{
+	out->clear();
+	bool asx = false;
+	bool in_entry = false;
+	bool in_title = false;
+	Item song;
+	char const *p = begin;
+	while (p < end) {
+		char const *lt = (char const *)memchr(p, '<', end - p);
+		if (!lt) break;
+		if (in_title) {
+			song.title = xml_unescape(decode(p, lt));
+			in_title = false;
+		}
+		char const *gt = (char const *)memchr(lt, '>', end - lt);
+		if (!gt) break;
+		char const *q = lt + 1;
+		bool closing = false;
+		if (q < gt && *q == '/') {
+			closing = true;
+			q++;
 		}
+		char const *name = q;
+		while (q < gt && isalpha(*q & 0xff)) q++;
+		if (equals(name, q, "asx", true)) {
+			asx = true;
+		} else if (equals(name, q, "entry", true)) {
+			if (closing) {
+				if (!song.file.isEmpty()) {
+					out->push_back(song);
+				}
+				in_entry = false;
+			} else {
+				song = Item();
+				in_entry = true;
+			}
+		} else if (equals(name, q, "title", true)) {
+			in_title = !closing && in_entry;
+		} else if (!closing && (equals(name, q, "ref", true) || equals(name, q, "entryref", true))) {
+			QString href = tag_attribute(q, gt, "href");
+			if (href.startsWith("http", Qt::CaseInsensitive) || href.startsWith("mms", Qt::CaseInsensitive)) {
+				if (!in_entry) {
+					Item item;
+					item.file = href;
+					out->push_back(item);
+				} else if (song.file.isEmpty()) { // 同じ entry の ref は代替なので最初のものを使う
+					song.file = href;
+				}
+			}
+		}
+		p = gt + 1;
 	}
-};
+	return asx;
+}
 
-bool PlaylistFile::parse(const QString &loc, std::vector<Item> *out)
+// 局一覧の JSON から "url" を持つオブジェクトを集める
+static void collect_json(QJsonValue const &value, std::vector<PlaylistFile::Item> *out, int depth)
+{
+	if (depth > 8) return;
+	if (value.isArray()) {
+		for (QJsonValue const &v : value.toArray()) {
+			collect_json(v, out, depth + 1);
+		}
+	} else if (value.isObject()) {
+		QJsonObject obj = value.toObject();
+		QString url = obj.value("url").toString();
+		if (url.startsWith("http://") || url.startsWith("https://")) {
+			PlaylistFile::Item item;
+			item.file = url;
+			item.title = obj.value("name").toString();
+			if (item.title.isEmpty()) {
+				item.title = obj.value("title").toString();
+			}
+			out->push_back(item);
+		}
+		for (auto it = obj.begin(); it != obj.end(); it++) {
+			if (it.value().isArray() || it.value().isObject()) {
+				collect_json(it.value(), out, depth + 1);
+			}
+		}
+	}
+}
+
+bool PlaylistFile::parse_json(char const *begin, char const *end, std::vector<PlaylistFile::Item> *out)
 {
 	out->clear();
-	bool parsed = false;
-	WebContext wc;
-	WebClient web(&wc);
-	MyWebClientHandler handler;
+	QJsonParseError err;
+	QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(begin, int(end - begin)), &err);
+	if (err.error != QJsonParseError::NoError) {
+		return false;
+	}
+	collect_json(doc.isArray() ? QJsonValue(doc.array()) : QJsonValue(doc.object()), out, 0);
+	return true;
+}
+
+// 内容の先頭、Content-Type、URL の拡張子の順に手がかりを見て形式を決める
+PlaylistFile::Format PlaylistFile::sniff(std::string const &content_type, QString const &loc, char const *begin, char const *end)
+{
+	char const *p = begin;
+	if (end - p >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0) p += 3; // BOM
+	while (p < end && isspace(*p & 0xff)) p++;
+
+	if (starts_with(p, end, "[playlist]", true)) return Format::PLS;
+	if (starts_with(p, end, "#EXTM3U", false)) return Format::M3U;
+	if (p < end && *p == '<') {
+		char const *head_end = p + std::min<ptrdiff_t>(end - p, 1024);
+		for (char const *q = p; q < head_end; q++) {
+			if (*q != '<') continue;
+			if (starts_with(q, head_end, "<asx", true)) return Format::ASX;
+			if (starts_with(q, head_end, "<playlist", true)) return Format::XSPF;
+		}
+	}
+	if (p < end && (*p == '{' || *p == '[')) return Format::JSON;
+
+	std::string ct;
+	for (char c : content_type) ct += (char)tolower(c & 0xff);
+	if (ct == "audio/x-scpls") return Format::PLS;
+	if (ct == "audio/x-mpegurl" || ct == "audio/mpegurl" || ct == "application/x-mpegurl" || ct == "application/vnd.apple.mpegurl") return Format::M3U;
+	if (ct == "application/xspf+xml") return Format::XSPF;
+	if (ct == "video/x-ms-asf" || ct == "video/x-ms-asx" || ct == "audio/x-ms-wax" || ct == "video/x-ms-wvx") return Format::ASX;
+	if (ct == "application/json") return Format::JSON;
+
+	QString path = QUrl(loc).path().toLower();
+	if (path.endsWith(".pls")) return Format::PLS;
+	if (path.endsWith(".m3u") || path.endsWith(".m3u8")) return Format::M3U;
+	if (path.endsWith(".xspf")) return Format::XSPF;
+	if (path.endsWith(".asx") || path.endsWith(".wax") || path.endsWith(".wvx")) return Format::ASX;
+	if (path.endsWith(".json")) return Format::JSON;
+
+	if (p < end && *p == '<') return Format::Unknown;
+	return Format::M3U; // URL を並べただけのもの
+}
+
+// Windows の OpenSSL はシステムの証明書ストアを使えないので、実行ファイルかデータの
+// ディレクトリに置いた ca-bundle.crt を読み込む。他の環境でもあれば追加で信頼する
+void PlaylistFile::loadCertificates(WebContext *webcx)
+{
+#if USE_OPENSSL
+	QStringList dirs;
+	dirs.push_back(QCoreApplication::applicationDirPath());
+	if (global && !global->application_data_dir.isEmpty()) {
+		dirs.push_back(global->application_data_dir);
+	}
+	for (QString const &dir : dirs) {
+		QString path = pathcat(dir, "ca-bundle.crt");
+		if (QFileInfo(path).isFile() && webcx->load_crt(path.toLocal8Bit().constData())) {
+			break;
+		}
+	}
+#else
+	(void)webcx;
+#endif
+}
+
+// 接続プールと HTTP キャッシュは解析間で共有する
+static WebContext *webContext()
+{
+	static WebContext *wc = [](){
+		WebContext *p = new WebContext();
+		PlaylistFile::loadCertificates(p);
+		QString dir = pathcat(global->application_data_dir, "httpcache");
+		if (QDir().mkpath(dir)) {
+			p->set_cache_dir(dir.toLocal8Bit().toStdString());
+		}
+		return p;
+	}();
+	return wc;
+}
+
+// 取得した本文を形式を見分けて解析する。base は相対パスを解決するための URL
+bool PlaylistFile::parse_content(std::string content_type, QString const &base, char const *begin, char const *end, std::vector<Item> *out)
+{
+	size_t i = content_type.find(';');
+	if (i != std::string::npos) {
+		content_type.resize(i);
+	}
+	while (!content_type.empty() && isspace(content_type.back() & 0xff)) {
+		content_type.pop_back();
+	}
+	switch (sniff(content_type, base, begin, end)) {
+	case Format::PLS:
+		return parse_pls(begin, end, out);
+	case Format::M3U:
+		return parse_m3u(begin, end, out, base);
+	case Format::XSPF:
+		return parse_xspf(begin, end, out);
+	case Format::ASX:
+		return parse_asx(begin, end, out);
+	case Format::JSON:
+		return parse_json(begin, end, out);
+	default:
+		return false;
+	}
+}
+
+bool PlaylistFile::parse(const QString &loc, std::vector<Item> *out, std::atomic<bool> const *cancel)
+{
+	out->clear();
+	WebClient web(webContext());
+	web.set_timeout(10000, 15000);
+	web.set_cancel_flag(cancel);
+	StreamProbeHandler handler(false, 16 * 1024 * 1024); // 音声ストリームはヘッダか先頭のバイトで打ち切られる
 	int s = web.get(WebClient::URL(loc.toStdString().c_str()), &handler);
-	if (s == 200 && !web.response()->content.empty()) {
+	if (s == 200 && handler.kind != StreamProbe::Kind::Stream && !web.response()->content.empty()) {
 		char const *begin = &web.response()->content[0];
 		char const *end = begin + web.response()->content.size();
-		parsed = parsed || PlaylistFile::parse_pls(begin, end, out);
-		parsed = parsed || PlaylistFile::parse_m3u(begin, end, out);
-		parsed = parsed || PlaylistFile::parse_xspf(begin, end, out);
+		return parse_content(web.content_type(), QString::fromStdString(web.final_url()), begin, end, out);
+	}
+	return false;
+}
+
+// 同じサーバにある複数のプレイリストを、一つの接続にまとめて要求する。
+// リダイレクトなど、まとめて取得できなかったものは一つずつ parse() し直す
+void PlaylistFile::parse(QStringList const &locs, std::vector<std::vector<Item>> *out, std::vector<bool> *parsed, std::atomic<bool> const *cancel)
+{
+	out->clear();
+	out->resize(locs.size());
+	parsed->assign(locs.size(), false);
+	std::vector<WebClient::URL> urls;
+	for (QString const &loc : locs) {
+		urls.emplace_back(loc.toStdString().c_str());
+	}
+	std::vector<WebClient::Response> responses;
+	{
+		WebClient web(webContext());
+		web.set_timeout(10000, 15000);
+		web.set_cancel_flag(cancel);
+		StreamProbeHandler handler(false, 16 * 1024 * 1024); // 音声ストリームなら、その要求だけ打ち切られる
+		web.get_all(urls, &responses, &handler);
+	}
+	for (int i = 0; i < locs.size(); i++) {
+		if (cancel && *cancel) break;
+		WebClient::Response const &r = responses[i];
+		if (r.code == 200 && !r.content.empty()) {
+			char const *begin = &r.content[0];
+			char const *end = begin + r.content.size();
+			std::string content_type = WebClient::header_value(&r.header, "Content-Type");
+			(*parsed)[i] = parse_content(content_type, locs[i], begin, end, &(*out)[i]);
+		} else if (r.code == 0 || WebClient::is_redirect(r.code)) { // 失敗したものや打ち切ったもの、リダイレクト
+			(*parsed)[i] = parse(locs[i], &(*out)[i], cancel);
+		}
 	}
-	return parsed;
 }
@@ -2,25 +2,46 @@
 #define PLAYLISTFILE_H
 
 #include <QString>
+#include <QStringList>
+#include <atomic>
+#include <string>
 #include <vector>
 
 class QString;
 class QByteArray;
+class WebContext;
 
 class PlaylistFile {
+	friend struct ParserHarness;
 public:
 	struct Item {
 		QString file;
 		QString title;
 		int length = -1;
+		int latency = -1; // 接続して応答が返るまでのミリ秒。-1 は未確認か到達できない
+	};
+	enum class Format {
+		Unknown,
+		PLS,
+		M3U,
+		XSPF,
+		ASX,
+		JSON,
 	};
 private:
 	std::vector<PlaylistFile::Item> locations_;
+	std::atomic<bool> cancel_ {false};
+	static Format sniff(std::string const &content_type, QString const &loc, char const *begin, char const *end);
 	static bool parse_pls(char const *begin, char const *end, std::vector<Item> *out);
-	static bool parse_m3u(char const *begin, char const *end, std::vector<Item> *out);
+	static bool parse_m3u(char const *begin, char const *end, std::vector<Item> *out, QString const &base = QString());
 	static bool parse_xspf(char const *begin, char const *end, std::vector<Item> *out);
-	static bool parse(const QString &loc, std::vector<Item> *out);
+	static bool parse_asx(char const *begin, char const *end, std::vector<Item> *out);
+	static bool parse_json(char const *begin, char const *end, std::vector<Item> *out);
+	static bool parse_content(std::string content_type, QString const &base, char const *begin, char const *end, std::vector<Item> *out);
 public:
+	static bool parse(const QString &loc, std::vector<Item> *out, std::atomic<bool> const *cancel);
+	static void parse(QStringList const &locs, std::vector<std::vector<Item>> *out, std::vector<bool> *parsed, std::atomic<bool> const *cancel);
+	static void loadCertificates(WebContext *webcx);
 
 	std::vector<PlaylistFile::Item> const *locations() const
 	{
@@ -29,7 +50,13 @@ public:
 
 	bool parse(QString const &loc)
 	{
-		return parse(loc, &locations_);
+		return parse(loc, &locations_, &cancel_);
+	}
+
+	// 別スレッドで実行中の parse() を中断させる（以後の parse() も失敗する）
+	void cancel()
+	{
+		cancel_ = true;
 	}
 };
 
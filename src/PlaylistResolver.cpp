@@ -0,0 +1,291 @@
+#include "PlaylistResolver.h"
+#include "StreamProbe.h"
+#include "webclient.h"
+
+#include <QMutex>
+#include <QUrl>
+#include <QWaitCondition>
+#include <algorithm>
+#include <climits>
+#include <deque>
+#include <memory>
+#include <set>
+
+struct PlaylistResolver::Task {
+	QString url;
+	QString title;
+	int depth = 0;
+	std::vector<int> order; // 入力順を保つための並び順
+};
+
+namespace {
+
+struct Stream {
+	PlaylistFile::Item item;
+	std::vector<int> order;
+};
+
+bool isPlaylistUrl(QString const &url)
+{
+	QString path = QUrl(url).path().toLower();
+	return path.endsWith(".pls") || path.endsWith(".m3u") || path.endsWith(".m3u8") || path.endsWith(".xspf") || path.endsWith(".asx");
+}
+
+QString originOf(QString const &url)
+{
+	QUrl u(url);
+	return u.scheme().toLower() + "://" + u.host().toLower() + ':' + QString::number(u.port(-1));
+}
+
+}
+
+struct PlaylistResolver::Private {
+	QMutex mutex;
+	QWaitCondition cond;
+	QStringList locations;
+	int worker_count = 4;
+	int max_depth = 3;
+	bool probe_enabled = true;
+	std::atomic<bool> cancel {false};
+	std::deque<Task> queue;
+	int busy = 0;
+	std::set<QString> seen;
+	std::vector<Stream> streams;
+	bool expanded = false;
+	size_t next_probe = 0;
+	std::vector<PlaylistFile::Item> items;
+	WebContext webcx;
+};
+
+class PlaylistResolver::Worker : public QThread {
+private:
+	PlaylistResolver *owner;
+protected:
+	void run()
+	{
+		std::vector<Task> tasks;
+		while (owner->takeTasks(&tasks)) {
+			if (tasks.size() == 1) {
+				std::vector<PlaylistFile::Item> items;
+				bool parsed = PlaylistFile::parse(tasks[0].url, &items, &owner->pv->cancel);
+				owner->finishTask(tasks[0], parsed, &items);
+				continue;
+			}
+			QStringList urls;
+			for (Task const &t : tasks) {
+				urls.push_back(t.url);
+			}
+			std::vector<std::vector<PlaylistFile::Item>> items;
+			std::vector<bool> parsed;
+			PlaylistFile::parse(urls, &items, &parsed, &owner->pv->cancel);
+			for (size_t i = 0; i < tasks.size(); i++) {
+				owner->finishTask(tasks[i], parsed[i], &items[i]);
+			}
+		}
+		if (owner->pv->probe_enabled) {
+			size_t i;
+			while (owner->takeProbe(&i)) {
+				owner->probe(i);
+			}
+		}
+	}
+public:
+	Worker(PlaylistResolver *owner)
+		: owner(owner)
+	{
+	}
+};
+
+PlaylistResolver::PlaylistResolver()
+{
+	pv = new Private();
+	PlaylistFile::loadCertificates(&pv->webcx);
+}
+
+PlaylistResolver::~PlaylistResolver()
+{
+	cancel();
+	wait();
+	delete pv;
+}
+
+void PlaylistResolver::setLocations(QStringList const &locations)
+{
+	pv->locations = locations;
+}
+
+void PlaylistResolver::setWorkerCount(int n)
+{
+	pv->worker_count = n < 1 ? 1 : n;
+}
+
+void PlaylistResolver::setMaxDepth(int n)
+{
+	pv->max_depth = n < 0 ? 0 : n;
+}
+
+void PlaylistResolver::setProbeEnabled(bool f)
+{
+	pv->probe_enabled = f;
+}
+
+void PlaylistResolver::cancel()
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->cancel = true;
+	pv->cond.wakeAll();
+}
+
+bool PlaylistResolver::isCancelled() const
+{
+	return pv->cancel;
+}
+
+// 入力のうちひとつでもプレイリストとして展開されたか
+bool PlaylistResolver::isExpanded() const
+{
+	return pv->expanded;
+}
+
+std::vector<PlaylistFile::Item> const *PlaylistResolver::items() const
+{
+	return &pv->items;
+}
+
+// 先頭のタスクと、同じサーバにある入れ子のプレイリストをまとめて取り出す。まとめたものは一つの接続で続けて要求する
+bool PlaylistResolver::takeTasks(std::vector<Task> *out)
+{
+	out->clear();
+	QMutexLocker lock(&pv->mutex);
+	while (pv->queue.empty() && pv->busy > 0 && !pv->cancel) { // 他のワーカーが新しいタスクを積むかもしれない
+		pv->cond.wait(&pv->mutex);
+	}
+	if (pv->queue.empty() || pv->cancel) {
+		pv->cond.wakeAll();
+		return false;
+	}
+	out->push_back(pv->queue.front());
+	pv->queue.pop_front();
+	if (out->front().depth > 0) { // 入力そのものはプレイリストかどうか分からないので一つずつ
+		QString origin = originOf(out->front().url);
+		for (auto it = pv->queue.begin(); it != pv->queue.end() && out->size() < 8; ) {
+			if (it->depth > 0 && originOf(it->url) == origin) {
+				out->push_back(*it);
+				it = pv->queue.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+	pv->busy += (int)out->size();
+	return true;
+}
+
+void PlaylistResolver::finishTask(Task const &task, bool parsed, std::vector<PlaylistFile::Item> *items)
+{
+	QMutexLocker lock(&pv->mutex);
+	pv->busy--;
+	if (!parsed) { // プレイリストでなければストリームとみなす
+		Stream s;
+		s.item.file = task.url;
+		s.item.title = task.title;
+		s.order = task.order;
+		pv->streams.push_back(s);
+	} else {
+		if (task.depth == 0) {
+			pv->expanded = true;
+		}
+		for (size_t i = 0; i < items->size(); i++) {
+			PlaylistFile::Item &item = items->at(i);
+			if (!pv->seen.insert(item.file).second) continue; // 重複
+			std::vector<int> order = task.order;
+			order.push_back((int)i);
+			if (item.title.isEmpty()) {
+				item.title = task.title;
+			}
+			if (task.depth < pv->max_depth && isPlaylistUrl(item.file)) {
+				Task t;
+				t.url = item.file;
+				t.title = item.title;
+				t.depth = task.depth + 1;
+				t.order = order;
+				pv->queue.push_back(t);
+			} else {
+				Stream s;
+				s.item = item;
+				s.order = order;
+				pv->streams.push_back(s);
+			}
+		}
+	}
+	pv->cond.wakeAll();
+}
+
+bool PlaylistResolver::takeProbe(size_t *index)
+{
+	QMutexLocker lock(&pv->mutex);
+	if (pv->cancel || !pv->expanded || pv->next_probe >= pv->streams.size()) { // 直接のストリームだけなら測らない
+		return false;
+	}
+	*index = pv->next_probe++;
+	return true;
+}
+
+void PlaylistResolver::probe(size_t index)
+{
+	QString url;
+	{
+		QMutexLocker lock(&pv->mutex);
+		url = pv->streams[index].item.file;
+	}
+	StreamProbe::Result r = StreamProbe::probe(&pv->webcx, url, &pv->cancel, 5000);
+	QMutexLocker lock(&pv->mutex);
+	pv->streams[index].item.latency = r.latency;
+}
+
+void PlaylistResolver::run()
+{
+	{
+		QMutexLocker lock(&pv->mutex);
+		pv->queue.clear();
+		pv->seen.clear();
+		pv->streams.clear();
+		pv->items.clear();
+		pv->expanded = false;
+		pv->busy = 0;
+		pv->next_probe = 0;
+		for (int i = 0; i < pv->locations.size(); i++) {
+			QString const &loc = pv->locations[i];
+			if (!pv->seen.insert(loc).second) continue;
+			Task t;
+			t.url = loc;
+			t.order.push_back(i);
+			pv->queue.push_back(t);
+		}
+	}
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	for (int i = 0; i < pv->worker_count; i++) {
+		workers.emplace_back(new Worker(this));
+		workers.back()->start();
+	}
+	for (auto &worker : workers) {
+		worker->wait();
+	}
+	if (pv->cancel) return;
+
+	std::vector<Stream> streams = pv->streams;
+	std::sort(streams.begin(), streams.end(), [](Stream const &l, Stream const &r){
+		return l.order < r.order;
+	});
+	if (pv->probe_enabled && pv->expanded) { // 到達できたものを応答の速い順に前へ
+		std::stable_sort(streams.begin(), streams.end(), [](Stream const &l, Stream const &r){
+			int a = l.item.latency < 0 ? INT_MAX : l.item.latency;
+			int b = r.item.latency < 0 ? INT_MAX : r.item.latency;
+			return a < b;
+		});
+	}
+	for (Stream const &s : streams) {
+		pv->items.push_back(s.item);
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef PLAYLISTRESOLVER_H
+#define PLAYLISTRESOLVER_H
+
+#include "PlaylistFile.h"
+
+#include <QStringList>
+#include <QThread>
+
+// 入力された複数のロケーションを並列に取得し、入れ子のプレイリストを展開してストリームの一覧を作る。
+// 同じサーバにある入れ子のプレイリストは、一つの接続にパイプラインでまとめて要求する。
+// 最後に各ストリームへ接続して応答時間を測り、到達できて速いものから並べる。
+class PlaylistResolver : public QThread {
+	Q_OBJECT
+private:
+	class Worker;
+	struct Task;
+	struct Private;
+	Private *pv;
+	bool takeTasks(std::vector<Task> *out);
+	void finishTask(Task const &task, bool parsed, std::vector<PlaylistFile::Item> *items);
+	bool takeProbe(size_t *index);
+	void probe(size_t index);
+protected:
+	void run();
+public:
+	PlaylistResolver();
+	~PlaylistResolver();
+	void setLocations(QStringList const &locations);
+	void setWorkerCount(int n);
+	void setMaxDepth(int n);
+	void setProbeEnabled(bool f);
+	void cancel();
+	bool isCancelled() const;
+	bool isExpanded() const;
+	std::vector<PlaylistFile::Item> const *items() const;
+};
+
+#endif // PLAYLISTRESOLVER_H
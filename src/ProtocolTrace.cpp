@@ -0,0 +1,243 @@
+#include "ProtocolTrace.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <string.h>
+
+namespace {
+
+char const MAGIC[] = "SKYMPCTR";
+int const VERSION = 1;
+
+enum {
+	TYPE_EXCHANGE = 1,
+	TYPE_DROPPED = 2,
+};
+
+void put_varint(QByteArray *out, quint64 v)
+{
+	while (v >= 0x80) {
+		out->append((char)(0x80 | (v & 0x7f)));
+		v >>= 7;
+	}
+	out->append((char)v);
+}
+
+bool get_varint(char const **ptr, char const *end, quint64 *v)
+{
+	*v = 0;
+	int shift = 0;
+	while (*ptr < end && shift < 64) {
+		unsigned char c = (unsigned char)*(*ptr)++;
+		*v |= (quint64)(c & 0x7f) << shift;
+		if (!(c & 0x80)) return true;
+		shift += 7;
+	}
+	return false;
+}
+
+bool get_bytes(char const **ptr, char const *end, QByteArray *out)
+{
+	quint64 n;
+	if (!get_varint(ptr, end, &n) || n > (quint64)(end - *ptr)) return false;
+	*out = QByteArray(*ptr, (int)n);
+	*ptr += n;
+	return true;
+}
+
+}
+
+struct ProtocolTrace::Private {
+	QMutex mutex;
+	QWaitCondition cond;
+	std::deque<Record> queue;
+	size_t queued_bytes = 0;
+	size_t max_buffer = 0;
+	quint64 dropped = 0;
+	std::atomic<bool> recording {false};
+	std::atomic<quint64> next_connection {1};
+	QElapsedTimer clock;
+	Writer *writer = nullptr;
+};
+
+class ProtocolTrace::Writer : public QThread {
+private:
+	QFile file;
+protected:
+	void run()
+	{
+		Private *pv = p();
+		while (1) {
+			std::deque<Record> records;
+			quint64 dropped;
+			bool stopping;
+			{
+				QMutexLocker lock(&pv->mutex);
+				if (pv->queue.empty() && pv->dropped == 0 && !isInterruptionRequested()) {
+					pv->cond.wait(&pv->mutex, 500);
+				}
+				records.swap(pv->queue);
+				pv->queued_bytes = 0;
+				dropped = pv->dropped;
+				pv->dropped = 0;
+				stopping = isInterruptionRequested();
+			}
+			QByteArray buf;
+			for (Record const &r : records) {
+				buf.append((char)TYPE_EXCHANGE);
+				put_varint(&buf, r.connection);
+				put_varint(&buf, r.sent_ns);
+				put_varint(&buf, r.duration_ns);
+				put_varint(&buf, (quint64)r.command.size());
+				buf.append(r.command);
+				put_varint(&buf, (quint64)r.response.size());
+				buf.append(r.response);
+			}
+			if (dropped > 0) {
+				buf.append((char)TYPE_DROPPED);
+				put_varint(&buf, dropped);
+			}
+			if (!buf.isEmpty()) {
+				file.write(buf);
+			}
+			if (stopping) break;
+		}
+		file.close();
+	}
+public:
+	bool open(QString const &path)
+	{
+		file.setFileName(path);
+		if (!file.open(QFile::WriteOnly | QFile::Truncate)) return false;
+		file.write(MAGIC, 8);
+		file.putChar((char)VERSION);
+		return true;
+	}
+};
+
+ProtocolTrace::Private *ProtocolTrace::p()
+{
+	static Private pv;
+	return &pv;
+}
+
+bool ProtocolTrace::start(QString const &path, size_t max_buffer)
+{
+	stop();
+	Private *pv = p();
+	Writer *w = new Writer();
+	if (!w->open(path)) {
+		delete w;
+		return false;
+	}
+	{
+		QMutexLocker lock(&pv->mutex);
+		pv->queue.clear();
+		pv->queued_bytes = 0;
+		pv->max_buffer = max_buffer;
+		pv->dropped = 0;
+		pv->clock.start();
+		pv->writer = w;
+	}
+	w->start(QThread::LowPriority);
+	pv->recording = true;
+	return true;
+}
+
+void ProtocolTrace::stop()
+{
+	Private *pv = p();
+	pv->recording = false;
+	Writer *w;
+	{
+		QMutexLocker lock(&pv->mutex);
+		w = pv->writer;
+		pv->writer = nullptr;
+		if (w) {
+			w->requestInterruption();
+			pv->cond.wakeAll();
+		}
+	}
+	if (w) {
+		w->wait();
+		delete w;
+	}
+}
+
+bool ProtocolTrace::isRecording()
+{
+	return p()->recording;
+}
+
+quint64 ProtocolTrace::newConnectionId()
+{
+	return p()->next_connection++;
+}
+
+quint64 ProtocolTrace::now()
+{
+	Private *pv = p();
+	QMutexLocker lock(&pv->mutex);
+	return pv->clock.isValid() ? (quint64)pv->clock.nsecsElapsed() : 0;
+}
+
+void ProtocolTrace::record(quint64 connection, quint64 sent_ns, QByteArray const &command, QByteArray const &response)
+{
+	Private *pv = p();
+	if (!pv->recording) return;
+	QMutexLocker lock(&pv->mutex);
+	if (!pv->writer) return;
+	size_t size = command.size() + response.size() + 32;
+	if (pv->queued_bytes + size > pv->max_buffer) {
+		pv->dropped++;
+		return;
+	}
+	Record r;
+	r.connection = connection;
+	r.sent_ns = sent_ns;
+	quint64 t = (quint64)pv->clock.nsecsElapsed();
+	r.duration_ns = t > sent_ns ? t - sent_ns : 0;
+	r.command = command;
+	r.response = response;
+	pv->queue.push_back(r);
+	pv->queued_bytes += size;
+	pv->cond.wakeAll();
+}
+
+bool ProtocolTrace::load(QString const &path, QList<Record> *out, quint64 *dropped)
+{
+	out->clear();
+	if (dropped) *dropped = 0;
+	QFile file(path);
+	if (!file.open(QFile::ReadOnly)) return false;
+	QByteArray data = file.readAll();
+	if (data.size() < 9 || memcmp(data.constData(), MAGIC, 8) != 0 || data[8] != (char)VERSION) {
+		return false;
+	}
+	char const *ptr = data.constData() + 9;
+	char const *end = data.constData() + data.size();
+	while (ptr < end) {
+		int type = (unsigned char)*ptr++;
+		if (type == TYPE_EXCHANGE) {
+			Record r;
+			if (!get_varint(&ptr, end, &r.connection)) return false;
+			if (!get_varint(&ptr, end, &r.sent_ns)) return false;
+			if (!get_varint(&ptr, end, &r.duration_ns)) return false;
+			if (!get_bytes(&ptr, end, &r.command)) return false;
+			if (!get_bytes(&ptr, end, &r.response)) return false;
+			out->push_back(r);
+		} else if (type == TYPE_DROPPED) {
+			quint64 n;
+			if (!get_varint(&ptr, end, &n)) return false;
+			if (dropped) *dropped += n;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,41 @@
+#ifndef PROTOCOLTRACE_H
+#define PROTOCOLTRACE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// MPD とのやりとりを記録する。記録する側は上限つきのバッファに積むだけで、ファイルへの書き込みは専用のスレッドが行う。
+// バッファがあふれたら捨てて、捨てた件数を記録に残す（UI を止めないことを優先する）。
+//
+// 応答を待たずに送るものも 1 コマンド 1 レコードにする
+//   idle: 送ってから変化が届くまで。noidle は応答がないので空の応答で残る
+//   albumart / readpicture: 続きのチャンクは先に何個か送っておくが、要求ごとにそれぞれの応答と組にする
+//
+// ファイル形式: "SKYMPCTR" + バージョン (1 バイト)、続いてレコードが並ぶ。数値はすべて LEB128 の可変長整数
+//   1: 接続番号, 送信時刻 (ns), 所要時間 (ns), コマンド長, コマンド, 応答長, 応答
+//   2: 捨てたレコードの数
+class ProtocolTrace {
+public:
+	struct Record {
+		quint64 connection = 0;
+		quint64 sent_ns = 0; // 記録開始からの時刻
+		quint64 duration_ns = 0;
+		QByteArray command;
+		QByteArray response;
+	};
+private:
+	class Writer;
+	struct Private;
+	static Private *p();
+public:
+	static bool start(QString const &path, size_t max_buffer = 16 * 1024 * 1024);
+	static void stop();
+	static bool isRecording();
+	static quint64 newConnectionId();
+	static quint64 now();
+	static void record(quint64 connection, quint64 sent_ns, QByteArray const &command, QByteArray const &response);
+	static bool load(QString const &path, QList<Record> *out, quint64 *dropped = nullptr);
+};
+
+#endif // PROTOCOLTRACE_H
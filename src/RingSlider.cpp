@@ -25,12 +25,16 @@ void RingSlider::updateGeometry()
 	int w = width() - handle_size_;
 	slider_rect_ = QRect(x, 3, w, height() - 6);
 
+	updateHandleRect();
+	invalidateCache();
+}
+
+void RingSlider::updateHandleRect()
+{
 	int val = (temporary_value_ == INT_MIN) ? value() : temporary_value_;
 	int max = maximum();
 	int handle_x = val * slider_rect_.width() / (max + 1) + slider_rect_.x() - handle_size_ / 2;
 	handle_rect_ = QRect(handle_x, 0, handle_size_, handle_size_);
-
-	slider_image_cache_ = QImage();
 }
 
 QSize RingSlider::sliderImageSize() const
@@ -43,12 +47,6 @@ void RingSlider::offset(int delta)
 	setValue(value() + delta);
 }
 
-void RingSlider::resizeEvent(QResizeEvent *e)
-{
-	QWidget::resizeEvent(e);
-	updateGeometry();
-}
-
 void RingSlider::keyPressEvent(QKeyEvent *e)
 {
 	int k = e->key();
@@ -75,69 +73,155 @@ void RingSlider::keyPressEvent(QKeyEvent *e)
 	}
 }
 
-void RingSlider::paintEvent(QPaintEvent *)
+void RingSlider::setTemporaryValue(int v)
 {
-	updateGeometry();
-
-	slider_image_cache_ = generateSliderImage();
+	QRect old = handle_rect_;
+	temporary_value_ = v;
+	updateHandleRect();
+	if (handle_rect_ != old) { // つまみの移動で変わるのは新旧の位置の間だけ
+		QRect r = old.united(handle_rect_);
+		update(r.left() - 1, 0, r.width() + 2, height());
+	}
+}
 
-	QPainter pr(this);
-	pr.setRenderHint(QPainter::Antialiasing);
+void RingSlider::invalidateCache()
+{
+	track_cache_ = QPixmap();
+	fill_cache_ = QPixmap();
+	frame_cache_ = QPixmap();
+	handle_cache_ = QPixmap();
+	slider_image_cache_ = QImage();
+	update();
+}
 
-	{
+void RingSlider::renderCache()
+{
+	cache_dpr_ = devicePixelRatio();
+	auto newPixmap = [&](QSize const &size){
+		QPixmap pm(size * cache_dpr_);
+		pm.setDevicePixelRatio(cache_dpr_);
+		pm.fill(Qt::transparent);
+		return pm;
+	};
 
-		int m = handle_rect_.height() / 2;
-		QRectF rf = QRectF(slider_rect_.adjusted(-m, 0, m, 0)).adjusted(0.5, 0.5, -0.5, -0.5);
-		double r = rf.height() / 2;
+	slider_image_cache_ = generateSliderImage();
 
-		int x0 = slider_rect_.x();
-		int x1 = handle_rect_.x() + handle_rect_.height() / 2;
-		QRect r2(x0 - m, slider_rect_.y(), x1 + m, slider_rect_.height());
+	int m = handle_size_ / 2;
+	QRectF rf = QRectF(slider_rect_.adjusted(-m, 0, m, 0)).adjusted(0.5, 0.5, -0.5, -0.5);
+	double r = rf.height() / 2;
+	QPainterPath path;
+	path.addRoundedRect(rf, r, r);
 
-		pr.save();
-		QPainterPath path;
-		path.addRoundedRect(rf, r, r);
-		pr.setClipPath(path);
-		{
-			QLinearGradient g(r2.topLeft(), r2.bottomLeft());
-			g.setColorAt(0, QColor(160, 160, 160));
-			g.setColorAt(1, QColor(192, 192, 192));
-			pr.fillPath(path, g);
+	track_cache_ = newPixmap(size());
+	{
+		QPainter pr(&track_cache_);
+		pr.setRenderHint(QPainter::Antialiasing);
+		QLinearGradient g(slider_rect_.topLeft(), slider_rect_.bottomLeft());
+		g.setColorAt(0, QColor(160, 160, 160));
+		g.setColorAt(1, QColor(192, 192, 192));
+		pr.fillPath(path, g);
+		if (!slider_image_cache_.isNull()) { // 派生クラスが作った画像をトラックの幅に引き伸ばして重ねる
+			pr.setClipPath(path);
+			pr.setRenderHint(QPainter::SmoothPixmapTransform);
+			pr.drawImage(rf, slider_image_cache_);
 		}
-		pr.restore();
+	}
 
-		pr.save();
+	// 全幅で描いておき、左から必要な幅と右端の丸みを切り出す
+	fill_cache_ = newPixmap(size());
+	{
+		QPainter pr(&fill_cache_);
+		pr.setRenderHint(QPainter::Antialiasing);
+		QRect r2(slider_rect_.x() - m, slider_rect_.y(), width(), slider_rect_.height());
 		QPainterPath path2;
 		path2.addRoundedRect(QRectF(r2).adjusted(0.5, 0.5, -0.5, -0.5), r, r);
-		{
-			QLinearGradient g(r2.topLeft(), r2.bottomLeft());
-			g.setColorAt(0, QColor(160, 192, 240));
-			g.setColorAt(1, QColor(80, 96, 120));
-			pr.fillPath(path2, g);
-		}
-		pr.restore();
+		QLinearGradient g(r2.topLeft(), r2.bottomLeft());
+		g.setColorAt(0, QColor(160, 192, 240));
+		g.setColorAt(1, QColor(80, 96, 120));
+		pr.fillPath(path2, g);
+	}
+
+	frame_cache_ = newPixmap(size());
+	{
+		QPainter pr(&frame_cache_);
+		pr.setRenderHint(QPainter::Antialiasing);
 		pr.setPen(QPen(Qt::black, 1));
 		pr.drawPath(path);
 	}
 
 	// slider handle
+	handle_cache_ = newPixmap(QSize(handle_size_, handle_size_));
 	{
+		QPainter pr(&handle_cache_);
+		pr.setRenderHint(QPainter::Antialiasing);
+		QRect rect(0, 0, handle_size_, handle_size_);
 		QPainterPath path;
-		path.addRect(rect());
+		path.addRect(rect);
 		QPainterPath path2;
-		path2.addEllipse(handle_rect_.adjusted(6, 6, -6, -6));
+		path2.addEllipse(rect.adjusted(6, 6, -6, -6));
 		path = path.subtracted(path2);
 		pr.setClipPath(path);
 
 		pr.setPen(Qt::NoPen);
 		pr.setBrush(Qt::black);
-		pr.drawEllipse(handle_rect_);
+		pr.drawEllipse(rect);
 		pr.setBrush(Qt::white);
-		pr.drawEllipse(handle_rect_.adjusted(1, 1, -1, -1));
-		pr.setPen(Qt::NoPen);
+		pr.drawEllipse(rect.adjusted(1, 1, -1, -1));
 		pr.setBrush(Qt::black);
-		pr.drawEllipse(handle_rect_.adjusted(5, 5, -5, -5));
+		pr.drawEllipse(rect.adjusted(5, 5, -5, -5));
+	}
+}
+
+void RingSlider::resizeEvent(QResizeEvent *e)
+{
+	QWidget::resizeEvent(e);
+	updateGeometry();
+}
+
+void RingSlider::changeEvent(QEvent *e)
+{
+	QSlider::changeEvent(e);
+	switch (e->type()) {
+	case QEvent::StyleChange:
+	case QEvent::PaletteChange:
+		invalidateCache();
+		break;
+	default:
+		break;
+	}
+}
+
+void RingSlider::sliderChange(SliderChange change)
+{
+	if (change == SliderValueChange) {
+		setTemporaryValue(temporary_value_);
+		return;
+	}
+	updateHandleRect();
+	QSlider::sliderChange(change);
+}
+
+void RingSlider::paintEvent(QPaintEvent *)
+{
+	if (track_cache_.isNull() || cache_dpr_ != devicePixelRatio()) {
+		renderCache();
+	}
+
+	// 描画は更新領域に切り抜かれるので、値の変化では細い帯だけが転送される
+	QPainter pr(this);
+	pr.drawPixmap(0, 0, track_cache_);
+	{
+		int fill_w = handle_rect_.x() + handle_size_;
+		int cap = std::min(fill_w, handle_size_ / 2);
+		int d = cache_dpr_;
+		int h = height();
+		if (fill_w > cap) {
+			pr.drawPixmap(QRectF(0, 0, fill_w - cap, h), fill_cache_, QRectF(0, 0, (fill_w - cap) * d, h * d));
+		}
+		pr.drawPixmap(QRectF(fill_w - cap, 0, cap, h), fill_cache_, QRectF((width() - cap) * d, 0, cap * d, h * d));
 	}
+	pr.drawPixmap(0, 0, frame_cache_);
+	pr.drawPixmap(handle_rect_.topLeft(), handle_cache_);
 }
 
 void RingSlider::mousePressEvent(QMouseEvent *e)
@@ -147,7 +231,7 @@ void RingSlider::mousePressEvent(QMouseEvent *e)
 		int x = e->pos().x();
 		int v = (x - slider_rect_.x()) * (maximum() - minimum()) / slider_rect_.width() + minimum();
 		v = std::max(minimum(), std::min(v, maximum()));
-		temporary_value_ = v;
+		setTemporaryValue(v);
 	}
 }
 
@@ -156,7 +240,7 @@ void RingSlider::mouseReleaseEvent(QMouseEvent *e)
 	if (QWidget::mouseGrabber() == this) {
 		emit sliderPressed();
 		setValue(temporary_value_);
-		temporary_value_ = INT_MIN;
+		setTemporaryValue(INT_MIN);
 		emit sliderReleased();
 	}
 	releaseMouse();
@@ -168,8 +252,7 @@ void RingSlider::mouseMoveEvent(QMouseEvent *e)
 		int x = e->pos().x();
 		int v = (x - slider_rect_.x()) * (maximum() - minimum()) / slider_rect_.width() + minimum();
 		v = std::max(minimum(), std::min(v, maximum()));
-		temporary_value_ = v;
-		update();
+		setTemporaryValue(v);
 	}
 }
 
@@ -1,6 +1,7 @@
 #ifndef RINGSLIDER_H
 #define RINGSLIDER_H
 
+#include <QPixmap>
 #include <QSlider>
 
 class RingSlider : public QSlider {
@@ -10,10 +11,22 @@ protected:
 	QRect handle_rect_;
 	int temporary_value_ = INT_MIN;
 	QImage slider_image_cache_;
+	// サイズやスタイルが変わるまで使い回す（devicePixelRatio 対応）
+	QPixmap track_cache_;
+	QPixmap fill_cache_;
+	QPixmap frame_cache_;
+	QPixmap handle_cache_;
+	int cache_dpr_ = 0;
 	void updateGeometry();
+	void updateHandleRect();
 	QSize sliderImageSize() const;
 	void offset(int delta);
+	void setTemporaryValue(int v);
+	void invalidateCache();
+	void renderCache();
 	void resizeEvent(QResizeEvent *e) override;
+	void changeEvent(QEvent *e) override;
+	void sliderChange(SliderChange change) override;
 	void keyPressEvent(QKeyEvent *e) override;
 	void paintEvent(QPaintEvent *) override;
 	void mousePressEvent(QMouseEvent *e) override;
@@ -17,17 +17,28 @@ void SelectLocationDialog::setItems(const std::vector<PlaylistFile::Item> *items
 {
 	this->items = items;
 	ui->tableWidget->setRowCount(items->size());
-	ui->tableWidget->setColumnCount(2);
+	ui->tableWidget->setColumnCount(3);
 	ui->tableWidget->setHorizontalHeaderItem(0, new QTableWidgetItem(tr("Title")));
-	ui->tableWidget->setHorizontalHeaderItem(1, new QTableWidgetItem(tr("Location")));
+	ui->tableWidget->setHorizontalHeaderItem(1, new QTableWidgetItem(tr("Response")));
+	ui->tableWidget->setHorizontalHeaderItem(2, new QTableWidgetItem(tr("Location")));
 	int i = 0;
 	for (PlaylistFile::Item const &item : *items) {
 		auto ti0 = new QTableWidgetItem();
 		ti0->setText(item.title);
 		ui->tableWidget->setItem(i, 0, ti0);
 		auto ti1 = new QTableWidgetItem();
-		ti1->setText(item.file);
+		ti1->setText(item.latency < 0 ? QString("-") : QString("%1 ms").arg(item.latency));
+		ti1->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
 		ui->tableWidget->setItem(i, 1, ti1);
+		auto ti2 = new QTableWidgetItem();
+		ti2->setText(item.file);
+		ui->tableWidget->setItem(i, 2, ti2);
+		if (item.latency < 0) { // 到達できなかったものは薄く表示する
+			QColor gray = palette().color(QPalette::Disabled, QPalette::Text);
+			ti0->setForeground(gray);
+			ti1->setForeground(gray);
+			ti2->setForeground(gray);
+		}
 		i++;
 	}
 
@@ -69,6 +69,7 @@ void SettingsDialog::loadSettings(ApplicationSettings *as)
 
 	s.beginGroup("UI");
 	BOOL_VALUE("EnableHighDpiScaling", enable_high_dpi_scaling);
+	INT_VALUE("HiddenUpdateInterval", hidden_update_interval);
 	s.endGroup();
 }
 
@@ -82,6 +83,7 @@ void SettingsDialog::saveSettings(ApplicationSettings const *as)
 
 	s.beginGroup("UI");
 	s.setValue("EnableHighDpiScaling", as->enable_high_dpi_scaling);
+	s.setValue("HiddenUpdateInterval", as->hidden_update_interval);
 	s.endGroup();
 }
 
@@ -1,22 +1,20 @@
 #include "MusicPlayerClient.h"
 #include "StatusThread.h"
 
-#include <QMutex>
+#include <atomic>
+#include <stdio.h>
+#include <string>
 
 struct StatusThread::Private {
-	QMutex mutex;
 	Host host;
 	MusicPlayerClient mpc;
-	bool f_status;
-	bool f_currentsong;
-	PlayingInfo info;
+	PlayerStatePtr state;
+	std::atomic<bool> idle_mode {false}; // ポーリングせずに MPD の idle で変化を待つ
 };
 
 StatusThread::StatusThread()
 {
 	pv = new Private();
-	pv->f_status = false;
-	pv->f_currentsong = false;
 }
 
 StatusThread::~StatusThread()
@@ -24,10 +22,9 @@ StatusThread::~StatusThread()
 	delete pv;
 }
 
-void StatusThread::data(PlayingInfo *out) const
+PlayerStatePtr StatusThread::state() const
 {
-	QMutexLocker lock(&pv->mutex);
-	*out = pv->info;
+	return std::atomic_load(&pv->state);
 }
 
 void StatusThread::setHost(Host const &host)
@@ -35,29 +32,120 @@ void StatusThread::setHost(Host const &host)
 	pv->host = host;
 }
 
+void StatusThread::setIdleMode(bool f)
+{
+	pv->idle_mode = f;
+}
+
 bool StatusThread::isOpen() const
 {
 	return pv->mpc.isOpen();
 }
 
+void StatusThread::parse(MusicPlayerClient::StringMap const &status, MusicPlayerClient::StringMap const &property, PlayerState *out)
+{
+	auto toInt = [](MusicPlayerClient::StringMap const &map, char const *name, int def){
+		auto it = map.map.find(name);
+		if (it != map.map.end()) {
+			bool ok = false;
+			int v = it->second.toInt(&ok);
+			if (ok) return v;
+		}
+		return def;
+	};
+
+	*out = PlayerState();
+	out->valid = !status.empty();
+
+	QString state = status.get("state");
+	if (state == "play") {
+		out->status = PlayingStatus::Play;
+	} else if (state == "pause") {
+		out->status = PlayingStatus::Pause;
+	}
+	out->song = toInt(status, "song", -1);
+	out->songid = toInt(status, "songid", -1);
+	out->nextsong = toInt(status, "nextsong", -1);
+	out->volume = toInt(status, "volume", -1);
+	out->repeat = toInt(status, "repeat", 0) != 0;
+	out->single = toInt(status, "single", 0) != 0;
+	out->consume = toInt(status, "consume", 0) != 0;
+	out->random = toInt(status, "random", 0) != 0;
+	out->playlist = (unsigned int)toInt(status, "playlist", 0);
+
+	{
+		std::string s = status.get("time").toStdString();
+		int t, e;
+		if (sscanf(s.c_str(), "%d:%d", &e, &t) == 2) {
+			out->elapsed = e;
+			out->total = t;
+		}
+	}
+	{
+		bool ok = false;
+		double e = status.get("elapsed").toDouble(&ok);
+		if (ok) {
+			out->elapsed = e;
+		}
+	}
+
+	PlayerState::Song *song = &out->current;
+	song->id = toInt(property, "Id", -1);
+	song->valid = song->id >= 0 && song->id == out->songid;
+	song->file = property.get("file");
+	song->title = property.get("Title");
+	song->artist = property.get("Artist");
+	song->album = property.get("Album");
+	song->track = toInt(property, "Track", 0);
+}
+
 void StatusThread::run()
 {
+	std::atomic_store(&pv->state, PlayerStatePtr());
+	PlayerStatePtr prev;
 	pv->mpc.open(pv->host);
 	while (1) {
 		if (isInterruptionRequested()) {
 			break;
 		}
 		if (isOpen()) {
-			PlayingInfo info;
-			pv->f_status = pv->mpc.do_status(&info.status);
-			pv->f_currentsong = pv->mpc.do_currentsong(&info.property);
-			{
-				QMutexLocker lock(&pv->mutex);
-				pv->info = info;
+			MusicPlayerClient::StringMap status;
+			MusicPlayerClient::StringMap property;
+			if (!pv->mpc.do_status(&status)) {
+				status.clear();
+			}
+			if (!pv->mpc.do_currentsong(&property)) {
+				property.clear();
+			}
+			std::shared_ptr<PlayerState> state = std::make_shared<PlayerState>();
+			parse(status, property, state.get());
+			state->dirty = prev ? PlayerState::diff(*prev, *state) : (unsigned int)PlayerState::AllDirty;
+			if (state->dirty) { // 変化がなければ何も通知しない
+				prev = state;
+				std::atomic_store(&pv->state, prev);
+				if (state->dirty & PlayerState::StateDirty) emit stateChanged();
+				if (state->dirty & PlayerState::SongDirty) emit songChanged();
+				if (state->dirty & PlayerState::OptionsDirty) emit optionsChanged();
+				if (state->dirty & PlayerState::VolumeDirty) emit volumeChanged();
+				if (state->dirty & PlayerState::ElapsedDirty) emit elapsedTick();
+			}
+		}
+		if (pv->idle_mode && isOpen()) {
+			// 再生位置は通知されないので、表示されていない間は進捗の更新も止まる
+			if (pv->mpc.do_idle("player mixer options playlist")) {
+				int r;
+				do {
+					r = pv->mpc.wait_idle(250, nullptr);
+				} while (r == 0 && pv->idle_mode && !isInterruptionRequested());
+				if (r == 0) { // 表示に戻ったらすぐにポーリングを再開する
+					pv->mpc.do_noidle(nullptr);
+				}
+			} else {
+				QThread::msleep(250);
 			}
-			emit onUpdate();
+		} else {
+			QThread::msleep(250);
 		}
-		QThread::msleep(250);
 	}
 	pv->mpc.close();
 }
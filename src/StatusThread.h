@@ -2,30 +2,31 @@
 #define STATUSTHREAD_H
 
 #include "MusicPlayerClient.h"
+#include "PlayerState.h"
 
 #include <QThread>
 
-class PlayingInfo {
-public:
-	MusicPlayerClient::StringMap status;
-	MusicPlayerClient::StringMap property;
-};
-
 class StatusThread : public QThread {
 	Q_OBJECT
 private:
 	struct Private;
 	Private *pv;
+	static void parse(MusicPlayerClient::StringMap const &status, MusicPlayerClient::StringMap const &property, PlayerState *out);
 protected:
 	void run();
 public:
 	StatusThread();
 	~StatusThread();
-	void data(PlayingInfo *out) const;
+	PlayerStatePtr state() const;
 	bool isOpen() const;
 	void setHost(const Host &host);
+	void setIdleMode(bool f);
 signals:
-	void onUpdate();
+	void stateChanged();
+	void songChanged();
+	void optionsChanged();
+	void volumeChanged();
+	void elapsedTick();
 };
 
 #endif // STATUSTHREAD_H
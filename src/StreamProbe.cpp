@@ -0,0 +1,180 @@
+#include "StreamProbe.h"
+
+#include <QElapsedTimer>
+#include <ctype.h>
+#include <string.h>
+
+namespace {
+
+std::string lower(std::string s)
+{
+	for (char &c : s) {
+		c = (char)tolower(c & 0xff);
+	}
+	return s;
+}
+
+bool starts_with_ci(char const *ptr, char const *end, char const *key)
+{
+	while (*key) {
+		if (ptr >= end || tolower(*ptr & 0xff) != tolower(*key & 0xff)) return false;
+		ptr++;
+		key++;
+	}
+	return true;
+}
+
+}
+
+StreamProbe::Kind StreamProbe::classify(WebClient const *wc)
+{
+	WebClient::Response const *r = wc->response();
+	if (!r->header.empty() && r->header[0].compare(0, 4, "ICY ") == 0) { // SHOUTcast v1
+		return Kind::Stream;
+	}
+	for (size_t i = 1; i < r->header.size(); i++) { // icy-name, icy-br, icy-metaint...
+		std::string const &line = r->header[i];
+		if (line.size() > 4 && starts_with_ci(line.c_str(), line.c_str() + line.size(), "icy-")) {
+			return Kind::Stream;
+		}
+	}
+	std::string ct = lower(wc->content_type());
+	if (ct == "audio/x-mpegurl" || ct == "audio/mpegurl" || ct == "audio/x-scpls" || ct == "audio/x-ms-wax"
+			|| ct == "application/x-mpegurl" || ct == "application/vnd.apple.mpegurl"
+			|| ct == "application/xspf+xml" || ct == "application/json" || ct == "application/xml"
+			|| ct == "video/x-ms-asx" || ct == "video/x-ms-wvx") {
+		return Kind::Playlist;
+	}
+	if (ct.compare(0, 6, "audio/") == 0 || ct == "application/ogg" || ct == "video/mp2t") {
+		return Kind::Stream;
+	}
+	if (ct.compare(0, 5, "text/") == 0 && ct != "text/html") {
+		return Kind::Playlist;
+	}
+	return Kind::Unknown; // application/octet-stream, video/x-ms-asf (ASX か ASF か), text/html など
+}
+
+// complete が偽で、まだ判断できなければ Unknown を返す
+StreamProbe::Kind StreamProbe::classify(char const *ptr, size_t len, bool complete)
+{
+	char const *end = ptr + len;
+	unsigned char const *u = (unsigned char const *)ptr;
+	if (len >= 4) {
+		if (memcmp(u, "ID3", 3) == 0 || memcmp(u, "OggS", 4) == 0 || memcmp(u, "fLaC", 4) == 0 || memcmp(u, "RIFF", 4) == 0) {
+			return Kind::Stream;
+		}
+		static unsigned char const asf[] = { 0x30, 0x26, 0xb2, 0x75 };
+		if (memcmp(u, asf, 4) == 0) {
+			return Kind::Stream;
+		}
+		if (u[0] == 0xff && (u[1] & 0xe0) == 0xe0) { // MPEG オーディオ / ADTS のフレーム同期
+			return Kind::Stream;
+		}
+	}
+	char const *p = ptr;
+	if (end - p >= 3 && memcmp(p, "\xef\xbb\xbf", 3) == 0) p += 3;
+	while (p < end && isspace(*p & 0xff)) p++;
+	if (starts_with_ci(p, end, "[playlist]") || starts_with_ci(p, end, "#EXT") || starts_with_ci(p, end, "http://") || starts_with_ci(p, end, "https://")) {
+		return Kind::Playlist;
+	}
+	if (p < end && (*p == '<' || *p == '{' || *p == '[')) {
+		return Kind::Playlist;
+	}
+	for (char const *q = ptr; q < end; q++) { // 制御文字があればバイナリ
+		int c = *q & 0xff;
+		if (c < 0x09 || (c > 0x0d && c < 0x20)) {
+			return Kind::Stream;
+		}
+	}
+	if (complete || len >= 512) {
+		return len > 0 ? Kind::Playlist : Kind::Unknown;
+	}
+	return Kind::Unknown;
+}
+
+void StreamProbeHandler::checkHeader(WebClient *wc)
+{
+	WebClient::Response const *r = wc->response();
+	code = r->code;
+	if (code == 0 && !r->header.empty() && r->header[0].compare(0, 7, "ICY 200") == 0) {
+		code = 200;
+	}
+	if (code / 100 == 3) return; // リダイレクトはたどらせる
+	content_type = wc->content_type();
+	head.clear();
+	total = 0;
+	kind = StreamProbe::classify(wc);
+	if (kind == StreamProbe::Kind::Stream || (stop_when_known && kind != StreamProbe::Kind::Unknown)) {
+		abort("classified");
+	}
+}
+
+void StreamProbeHandler::checkContent(char const *ptr, size_t len)
+{
+	if (code / 100 == 3) return; // リダイレクトの本文（HTML の案内など）は判定に使わない
+	total += len;
+	if (kind == StreamProbe::Kind::Unknown) {
+		size_t n = std::min(len, 512 - head.size());
+		head.append(ptr, n);
+		kind = StreamProbe::classify(head.c_str(), head.size(), false);
+		if (kind == StreamProbe::Kind::Stream || (stop_when_known && kind != StreamProbe::Kind::Unknown)) {
+			abort("classified");
+		}
+	}
+	if (total > max_bytes) {
+		abort("too large");
+	}
+}
+
+// 本文を読み終えたのに決まらなければ、読めた分だけで判断する
+void StreamProbeHandler::finish()
+{
+	if (kind == StreamProbe::Kind::Unknown && !head.empty()) {
+		kind = StreamProbe::classify(head.c_str(), head.size(), true);
+	}
+}
+
+StreamProbe::Result StreamProbe::probe(WebContext *webcx, QString const &url, std::atomic<bool> const *cancel, int timeout_ms)
+{
+	Result result;
+	WebClient::URL u(url.toStdString().c_str());
+	WebClient web(webcx);
+	web.set_timeout(timeout_ms, timeout_ms);
+	web.set_cancel_flag(cancel);
+	web.set_store_content(false);
+	QElapsedTimer t;
+	t.start();
+	{
+		StreamProbeHandler handler(true, 0);
+		web.head(u, &handler);
+		if (handler.code >= 200 && handler.code < 300) {
+			result.latency = (int)t.elapsed();
+			result.code = handler.code;
+			result.content_type = handler.content_type;
+			result.kind = handler.kind;
+			if (result.kind != Kind::Unknown) {
+				return result;
+			}
+		}
+	}
+	if (cancel && *cancel) {
+		return result;
+	}
+	// HEAD に応じないサーバや、ヘッダだけでは決まらないものは先頭だけ取得する
+	web.add_header("Range: bytes=0-4095");
+	StreamProbeHandler handler(true, 4096);
+	t.restart();
+	web.get(u, &handler);
+	handler.finish();
+	if (handler.code >= 200 && handler.code < 300) {
+		if (result.latency < 0) {
+			result.latency = (int)t.elapsed();
+		}
+		result.code = handler.code;
+		result.content_type = handler.content_type;
+		result.kind = handler.kind;
+	} else if (result.code == 0) {
+		result.kind = Kind::Unreachable;
+	}
+	return result;
+}
@@ -0,0 +1,51 @@
+#ifndef STREAMPROBE_H
+#define STREAMPROBE_H
+
+#include "webclient.h"
+
+#include <QString>
+#include <atomic>
+#include <string>
+
+// URL が音声ストリームかプレイリストかを、ヘッダと先頭の数バイトだけで判定する
+class StreamProbe {
+public:
+	enum class Kind {
+		Unknown,
+		Stream,
+		Playlist,
+		Unreachable,
+	};
+	struct Result {
+		Kind kind = Kind::Unknown;
+		int code = 0;
+		std::string content_type;
+		int latency = -1; // ms
+	};
+	static Kind classify(WebClient const *wc);
+	static Kind classify(char const *ptr, size_t len, bool complete);
+	static Result probe(WebContext *webcx, QString const &url, std::atomic<bool> const *cancel, int timeout_ms = 5000);
+};
+
+// ストリームと分かった時点で受信を打ち切る。stop_when_known なら種類が決まった時点で打ち切る
+class StreamProbeHandler : public WebClientHandler {
+private:
+	bool stop_when_known;
+	std::string head;
+public:
+	StreamProbe::Kind kind = StreamProbe::Kind::Unknown;
+	int code = 0;
+	std::string content_type;
+	size_t total = 0;
+	size_t max_bytes;
+	StreamProbeHandler(bool stop_when_known, size_t max_bytes)
+		: stop_when_known(stop_when_known)
+		, max_bytes(max_bytes)
+	{
+	}
+	void checkHeader(WebClient *wc);
+	void checkContent(char const *ptr, size_t len);
+	void finish();
+};
+
+#endif // STREAMPROBE_H
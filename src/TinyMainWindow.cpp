@@ -79,6 +79,8 @@ TinyMainWindow::TinyMainWindow(QWidget *parent) :
 	m->menu.addAction(ui->action_help_about);
 	m->menu.addAction(ui->action_debug);
 
+	m->albumart_thread.setImageSize(ui->label->maximumSize() * devicePixelRatio());
+
 	setRepeatEnabled(false);
 	setRandomEnabled(false);
 
@@ -178,6 +180,18 @@ void TinyMainWindow::updatePlayIcon()
 	BasicMainWindow::updatePlayIcon(m->status.now.status, ui->toolButton_play, ui->action_play);
 }
 
+void TinyMainWindow::displayAlbumArt(const QImage &image)
+{
+	QPixmap pm;
+	if (image.isNull()) {
+		pm = QPixmap(":/image/appicon.png");
+	} else {
+		pm = QPixmap::fromImage(image);
+		pm.setDevicePixelRatio(devicePixelRatio());
+	}
+	ui->label->setPixmap(pm);
+}
+
 void TinyMainWindow::displayProgress(const QString &text)
 {
 	m->status_label1->setText(text);
@@ -37,6 +37,7 @@ protected:
 	void changeEvent(QEvent *e);
 	void displayCurrentSongLabels(const QString &, const QString &, const QString &);
 	void displayProgress(const QString &text);
+	void displayAlbumArt(const QImage &image);
 	void updatePlayIcon();
 	void displayExtraInformation(const QString &text2, const QString &text3);
 
@@ -0,0 +1,120 @@
+#include "UpdateScheduler.h"
+
+#include <QEvent>
+#include <QScreen>
+#include <QWidget>
+#include <QWindow>
+
+UpdateScheduler::UpdateScheduler()
+{
+	timer_.setSingleShot(true);
+	connect(&timer_, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+void UpdateScheduler::setWindow(QWidget *window)
+{
+	if (window_) {
+		window_->removeEventFilter(this);
+	}
+	if (handle_) {
+		handle_->removeEventFilter(this);
+		handle_ = nullptr;
+	}
+	window_ = window;
+	if (window_) {
+		window_->installEventFilter(this);
+	}
+	updateVisibility();
+}
+
+void UpdateScheduler::setFrameInterval(int ms)
+{
+	frame_interval_ = ms < 1 ? 1 : ms;
+	reschedule();
+}
+
+void UpdateScheduler::setHiddenInterval(int ms)
+{
+	hidden_interval_ = ms;
+	reschedule();
+}
+
+bool UpdateScheduler::isWindowVisible() const
+{
+	return visible_;
+}
+
+void UpdateScheduler::post(unsigned int dirty)
+{
+	dirty_ |= dirty;
+	if (!timer_.isActive()) {
+		reschedule();
+	}
+}
+
+void UpdateScheduler::flushNow()
+{
+	timer_.stop();
+	onTimeout();
+}
+
+void UpdateScheduler::reschedule()
+{
+	timer_.stop();
+	if (dirty_ == 0) return;
+	if (visible_) {
+		timer_.start(frame_interval_);
+	} else if (hidden_interval_ > 0) {
+		timer_.start(hidden_interval_);
+	}
+}
+
+void UpdateScheduler::updateVisibility()
+{
+	if (window_ && !handle_ && window_->windowHandle()) {
+		handle_ = window_->windowHandle();
+		handle_->installEventFilter(this);
+	}
+	bool visible = !window_ || (window_->isVisible() && !window_->isMinimized());
+	if (visible && window_ && window_->windowHandle() && !window_->windowHandle()->isExposed()) {
+		visible = false;
+	}
+	if (visible != visible_) {
+		visible_ = visible;
+		reschedule(); // 表示されたら溜まっていた変化を次のフレームで反映する
+		emit visibilityChanged(visible_);
+	}
+	if (visible_ && window_ && window_->windowHandle() && window_->windowHandle()->screen()) {
+		qreal hz = window_->windowHandle()->screen()->refreshRate();
+		if (hz >= 1) {
+			frame_interval_ = (int)(1000 / hz);
+		}
+	}
+}
+
+bool UpdateScheduler::eventFilter(QObject *watched, QEvent *event)
+{
+	if (watched == handle_ && event->type() == QEvent::Expose) {
+		updateVisibility();
+	} else if (watched == window_) {
+		switch (event->type()) {
+		case QEvent::Show:
+		case QEvent::Hide:
+		case QEvent::WindowStateChange:
+			updateVisibility();
+			break;
+		default:
+			break;
+		}
+	}
+	return QObject::eventFilter(watched, event);
+}
+
+void UpdateScheduler::onTimeout()
+{
+	unsigned int dirty = dirty_;
+	dirty_ = 0;
+	if (dirty) {
+		emit flush(dirty);
+	}
+}
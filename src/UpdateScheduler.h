@@ -0,0 +1,40 @@
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+
+class QWidget;
+
+// 状態の変化を溜めておき、表示の 1 フレームに 1 回だけまとめて反映させる。
+// ウィンドウが隠れているか、最小化されているか、他のウィンドウに覆われているときは hiddenInterval ごとに反映する（0 以下なら表示されるまで待つ）。
+class UpdateScheduler : public QObject {
+	Q_OBJECT
+private:
+	QWidget *window_ = nullptr;
+	QObject *handle_ = nullptr; // 隠れているかどうかは QWindow の Expose で分かる
+	QTimer timer_;
+	unsigned int dirty_ = 0;
+	int frame_interval_ = 16; // ms
+	int hidden_interval_ = 1000; // ms
+	bool visible_ = true;
+	void reschedule();
+	void updateVisibility();
+protected:
+	bool eventFilter(QObject *watched, QEvent *event);
+public:
+	UpdateScheduler();
+	void setWindow(QWidget *window);
+	void setFrameInterval(int ms);
+	void setHiddenInterval(int ms);
+	bool isWindowVisible() const;
+	void post(unsigned int dirty);
+	void flushNow();
+signals:
+	void flush(unsigned int dirty);
+	void visibilityChanged(bool visible);
+private slots:
+	void onTimeout();
+};
+
+#endif // UPDATESCHEDULER_H
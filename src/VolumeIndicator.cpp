@@ -1,4 +1,5 @@
 #include "VolumeIndicator.h"
+#include "ImageKernels.h"
 #include <QPainter>
 VolumeIndicator::VolumeIndicator(QWidget *parent) :
     QSlider(parent)
@@ -20,12 +21,12 @@ void VolumeIndicator::paintEvent(QPaintEvent *)
 
 	v = (v - minimum()) * w / (maximum() - minimum());
 
-	for (int i = 0; i < w; i++) {
-		if (i < v) {
-			int t = (h - 1) * i / w + 1;
-			int y = h - 1 - t;
-			pr.fillRect(i, y, 1, t, Qt::black);
-		}
+	// 三角形は大きさが変わったときだけ作り直し、音量の分だけ左から切り出す
+	if (wedge_image_.size() != size()) {
+		wedge_image_ = makeWedgeImage(w, h, qRgb(0, 0, 0));
+	}
+	if (v > 0) {
+		pr.drawImage(QRect(0, 0, v, h), wedge_image_, QRect(0, 0, v, h));
 	}
 }
 
@@ -6,6 +6,8 @@
 class VolumeIndicator : public QSlider
 {
 	Q_OBJECT
+private:
+	QImage wedge_image_;
 public:
 	explicit VolumeIndicator(QWidget *parent = 0);
 	virtual void paintEvent(QPaintEvent *e);
@@ -5,6 +5,7 @@
 #include "main.h"
 #include "LegacyWindowsStyleTreeControl.h"
 #include "ApplicationGlobal.h"
+#include "ProtocolTrace.h"
 #include <QApplication>
 #include <QTextCodec>
 #include <QMessageBox>
@@ -127,6 +128,13 @@ int main(int argc, char *argv[])
         a.installTranslator(&translator);
     }
 
+	{ // 起動直後から記録したいときのため
+		QByteArray trace = qgetenv("SKYMPC_TRACE");
+		if (!trace.isEmpty()) {
+			ProtocolTrace::start(QString::fromLocal8Bit(trace));
+		}
+	}
+
 	BasicMainWindow *mw;
 	if (tiny) {
 		mw = new TinyMainWindow();
@@ -147,6 +155,8 @@ int main(int argc, char *argv[])
 
 	delete mw;
 
+	ProtocolTrace::stop();
+
 	return r;
 }
 
@@ -18,6 +18,7 @@ enum {
 struct ApplicationSettings {
 	bool remember_and_restore_window_position = true;
 	bool enable_high_dpi_scaling = false;
+	int hidden_update_interval = 1000; // ウィンドウが見えていないときの表示更新の間隔 (ms)。0 以下なら更新しない
 	static ApplicationSettings defaultSettings()
 	{
 		ApplicationSettings s;
@@ -0,0 +1,31 @@
+#include "misc.h"
+
+// GUI を使わないツールからも Server.cpp を使えるように misc.cpp から分けてある
+
+void pseudo_crypto_encode(char *ptr, int len)
+{
+	if (len > 1) {
+		unsigned char *p = (unsigned char *)ptr;
+		int n = len - 1;
+		for (int i = 0; i < n; i++) {
+			p[i + 1] = p[i + 1] ^ (p[i] * 27 + 13);
+		}
+		for (int i = 0; i < n; i++) {
+			p[n - i - 1] = p[n - i - 1] ^ (p[n - i] * 31 + 11);
+		}
+	}
+}
+
+void pseudo_crypto_decode(char *ptr, int len)
+{
+	if (len > 1) {
+		unsigned char *p = (unsigned char *)ptr;
+		int n = len - 1;
+		for (int i = 0; i < n; i++) {
+			p[i] = p[i] ^ (p[i + 1] * 31 + 11);
+		}
+		for (int i = 0; i < n; i++) {
+			p[n - i] = p[n - i] ^ (p[n - i - 1] * 27 + 13);
+		}
+	}
+}
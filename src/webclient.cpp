@@ -1,11 +1,16 @@
+#include "webclient.h" // USE_OPENSSL / USE_ZLIB の既定値はここで決まるので最初に読む
 
 #ifdef WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #include <windows.h>
 #pragma comment(lib, "ws2_32.lib")
 #if USE_OPENSSL
-#pragma comment(lib, "libeay32.lib")
-#pragma comment(lib, "ssleay32.lib")
+#pragma comment(lib, "libcrypto.lib")
+#pragma comment(lib, "libssl.lib")
+#endif
+#if USE_ZLIB
+#pragma comment(lib, "zlib.lib")
 #endif
 typedef SOCKET socket_t;
 #else
@@ -13,22 +18,29 @@ typedef SOCKET socket_t;
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
 #include <netinet/in.h>
 #include <net/if.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <errno.h>
 #define closesocket(S) close(S)
 typedef int socket_t;
 #define INVALID_SOCKET (-1)
 #define SOCKET_ERROR (-1)
 #endif
 
-#include "webclient.h"
-
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/types.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
 
 #if USE_OPENSSL
 #include <openssl/crypto.h>
@@ -36,54 +48,159 @@ typedef int socket_t;
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
+#include <openssl/x509v3.h>
+#else
+typedef void SSL;
+#endif
+
+#if USE_ZLIB
+#include <zlib.h>
 #endif
 
 #pragma warning(disable:4996)
 
 #define USER_AGENT "Generic Web Client"
 
+typedef std::chrono::steady_clock Clock;
+
 struct WebContext::Private {
 #if USE_OPENSSL
 	SSL_CTX *ctx;
+#endif
+	// host:port ごとの待機中（keep-alive）の接続
+	struct IdleSocket {
+		socket_t sock;
+		SSL *ssl;
+		Clock::time_point since;
+	};
+	std::mutex mutex;
+	std::map<std::string, std::vector<IdleSocket>> idle;
+	std::string cache_dir;
+	socket_t take(std::string const &key, SSL **ssl);
+	void put(std::string const &key, socket_t sock, SSL *ssl);
+	void clear();
+#if USE_OPENSSL
+	// host:port ごとに直近の TLS セッションを覚えておき、再接続時の完全なハンドシェイクを省く
+	std::map<std::string, SSL_SESSION *> sessions;
+	SSL_SESSION *session(std::string const &key);
+	void set_session(std::string const &key, SSL_SESSION *sess);
 #endif
 };
 
+static void close_connection(socket_t sock, SSL *ssl)
+{
+#if USE_OPENSSL
+	if (ssl) {
+		SSL_shutdown(ssl);
+		SSL_free(ssl);
+	}
+#else
+	(void)ssl;
+#endif
+	closesocket(sock);
+}
+
 WebClient::URL::URL(char const *str)
 {
-	char const *left;
-	char const *right;
-	left = str;
-	right = strstr(left, "://");
-	if (right) {
-		scheme_.assign(str, right - str);
-		left = right + 3;
-	}
-	right = strchr(left, '/');
-	if (right) {
-		char const *p = strchr(left, ':');
-		if (p && left < p && p < right) {
-			int n = 0;
-			char const *q = p + 1;
-			while (q < right) {
-				if (isdigit(*q & 0xff)) {
-					n = n * 10 + (*q - '0');
-				} else {
-					n = -1;
-					break;
-				}
-				q++;
+	char const *left = str;
+	char const *p = str;
+	if (isalpha(*p & 0xff)) { // スキームは英字で始まり、英数字と + - . が続く
+		do {
+			p++;
+		} while (isalnum(*p & 0xff) || *p == '+' || *p == '-' || *p == '.');
+	}
+	if (p > str && strncmp(p, "://", 3) == 0) {
+		scheme_.assign(str, p - str);
+		left = p + 3;
+	} else { // example.com/x のようにスキームが省略されていれば http とみなす
+		scheme_ = "http";
+	}
+	char const *right = left + strcspn(left, "/?#");
+	if (*right == '/') {
+		path_ = right;
+	} else { // パスが省略されている
+		path_ = '/' + std::string(right);
+	}
+	char const *at = nullptr; // user:pass@ は使わないので読み飛ばす
+	for (char const *q = left; q < right; q++) {
+		if (*q == '@') at = q;
+	}
+	if (at) {
+		left = at + 1;
+	}
+	char const *colon;
+	if (left < right && *left == '[') { // IPv6 のアドレスは [::1]:8080 のように書かれる。括弧の中の : は区切りではない
+		char const *close = (char const *)memchr(left, ']', right - left);
+		if (!close || memchr(left + 1, '[', close - left - 1) || (close + 1 < right && close[1] != ':')) { // 括弧が閉じていないものなどは不正な URL とし、ホストを空のままにする
+			return;
+		}
+		host_.assign(left + 1, close);
+		colon = close + 1 < right ? close + 1 : nullptr;
+	} else {
+		colon = (char const *)memchr(left, ':', right - left);
+		host_.assign(left, colon ? colon : right);
+	}
+	if (colon) {
+		int n = 0;
+		for (char const *q = colon + 1; q < right; q++) {
+			if (!isdigit(*q & 0xff)) {
+				n = -1;
+				break;
 			}
-			host_.assign(left, p - left);
-			if (n > 0 && n < 65536) {
-				port_ = n;
+			n = n * 10 + (*q - '0');
+			if (n > 65535) { // 桁が多すぎるとあふれる
+				n = -1;
+				break;
 			}
-		} else {
-			host_.assign(left, right - left);
 		}
-		path_ = right;
+		if (n > 0) {
+			port_ = n;
+		}
 	}
 }
 
+// Host ヘッダや URL に書くときの形。IPv6 のアドレスは括弧で囲む
+std::string WebClient::URL::host_literal() const
+{
+	if (host_.find(':') != std::string::npos) {
+		return '[' + host_ + ']';
+	}
+	return host_;
+}
+
+std::string WebClient::URL::str() const
+{
+	std::string s = scheme_ + "://" + host_literal();
+	if (port_ > 0) {
+		char tmp[16];
+		sprintf(tmp, ":%d", port_);
+		s += tmp;
+	}
+	return s + path_;
+}
+
+// Location ヘッダの値を base からの相対として解決する
+std::string WebClient::URL::resolve(std::string const &location) const
+{
+	if (location.find("://") != std::string::npos) {
+		return location;
+	}
+	if (location.compare(0, 2, "//") == 0) {
+		return scheme_ + ':' + location;
+	}
+	std::string origin = str();
+	origin.resize(origin.size() - path_.size());
+	if (!location.empty() && location[0] == '/') {
+		return origin + location;
+	}
+	std::string dir = path_.substr(0, path_.find_first_of("?#"));
+	dir = dir.substr(0, dir.rfind('/') + 1);
+	if (dir.empty()) {
+		dir = "/";
+	}
+	return origin + dir + location;
+}
+
 bool WebClient::URL::isssl() const
 {
 	if (scheme() == "https") return true;
@@ -113,7 +230,7 @@ void WebClient::initialize()
 #ifdef WIN32
 	WSADATA wsaData;
 	WORD wVersionRequested;
-	wVersionRequested = MAKEWORD(1, 1);
+	wVersionRequested = MAKEWORD(2, 2);
 	WSAStartup(wVersionRequested, &wsaData);
 	atexit(cleanup);
 #endif
@@ -170,74 +287,46 @@ static inline std::string to_s(size_t n)
 	return tmp;
 }
 
-void WebClient::set_default_headers(URL const &uri, Post const *post)
+void WebClient::set_default_headers(URL const &uri, Post const *post, std::vector<std::string> *out)
 {
-	add_header("Host: " + uri.host());
-	add_header("User-Agent: " USER_AGENT);
-	add_header("Accept: */*");
-	add_header("Connection: close");
+	out->push_back("Host: " + uri.host_literal());
+	out->push_back("User-Agent: " USER_AGENT);
+	out->push_back("Accept: */*");
+#if USE_ZLIB
+	out->push_back("Accept-Encoding: gzip, deflate");
+#endif
+	out->push_back("Connection: keep-alive");
 	if (post) {
-		add_header("Content-Length: " + to_s(post->data.size()));
-		add_header("Content-Type: application/x-www-form-urlencoded");
+		out->push_back("Content-Length: " + to_s(post->data.size()));
+		out->push_back("Content-Type: application/x-www-form-urlencoded");
 	}
 }
 
-std::string WebClient::make_http_request(URL const &uri, Post const *post)
+std::string WebClient::make_http_request(URL const &uri, Post const *post, std::vector<std::string> const *extra)
 {
 	std::string str;
 
-	str = post ? "POST " : "GET ";
+	str = post ? "POST " : (data.head ? "HEAD " : "GET ");
 	str += uri.path();
-	str += " HTTP/1.0";
+	str += " HTTP/1.1";
 	str += "\r\n";
 
-	for (std::vector<std::string>::const_iterator it = data.request_headers.begin(); it != data.request_headers.end(); it++) {
+	std::vector<std::string> headers;
+	set_default_headers(uri, post, &headers);
+	headers.insert(headers.end(), data.request_headers.begin(), data.request_headers.end());
+	if (extra) {
+		headers.insert(headers.end(), extra->begin(), extra->end());
+	}
+	for (std::vector<std::string>::const_iterator it = headers.begin(); it != headers.end(); it++) {
 		str += *it;
 		str += "\r\n";
 	}
 
 	str += "\r\n";
-	return str;
-}
-
-void WebClient::parse_http_header(char const *begin, char const *end, std::vector<std::string> *header)
-{
-	if (begin < end) {
-		char const *left = begin;
-		char const *right = left;
-		while (1) {
-			if (right >= end) {
-				break;
-			}
-			if (*right == '\r' || *right == '\n') {
-				if (left < right) {
-					header->push_back(std::string(left, right));
-				}
-				if (right + 1 < end && *right == '\r' && right[1] == '\n') {
-					right++;
-				}
-				right++;
-				if (*right == '\r' || *right == '\n') {
-					if (right + 1 < end && *right == '\r' && right[1] == '\n') {
-						right++;
-					}
-					right++;
-					left = right;
-					break;
-				}
-				left = right;
-			} else {
-				right++;
-			}
-		}
+	if (post && !post->data.empty()) {
+		str.append((char const *)&post->data[0], post->data.size());
 	}
-}
-
-void WebClient::parse_http_header(const char *begin, const char *end, WebClient::Response *out)
-{
-	*out = Response();
-	parse_http_header(begin, end, &out->header);
-	parse_header(&out->header, out);
+	return str;
 }
 
 static void send_(socket_t s, char const *ptr, int len)
@@ -252,335 +341,983 @@ static void send_(socket_t s, char const *ptr, int len)
 	}
 }
 
-void WebClient::on_end_header(std::vector<char> const *vec, WebClientHandler *handler)
+void WebClient::begin_response()
 {
-	if (vec->empty()) return;
-	char const *begin = &vec->at(0);
-	char const *end = begin + vec->size();
-	parse_http_header(begin, end, &data.response);
-	if (handler) {
-		handler->checkHeader(this);
-	}
+	data.response = Response();
+	data.header_line.clear();
+	data.header_done = false;
+	data.header_bytes = 0;
+	data.content_bytes = 0;
 }
 
-void WebClient::append(char const *ptr, size_t len, std::vector<char> *out, WebClientHandler *handler)
+size_t WebClient::append_header(char const *ptr, size_t len, WebClientHandler *handler)
 {
-	size_t offset = out->size();
-	out->insert(out->end(), ptr, ptr + len);
-
-	if (data.crlf_state < 0) {
-		// nop
-	} else {
-		for (size_t i = 0; i < len; i++) {
-			int c = ptr[i] & 0xff;
-			if (c == '\r') {
-				data.crlf_state |= 1;
-			} else if (c == '\n') {
-				data.crlf_state |= 1;
-				data.crlf_state++;
-			} else {
-				data.crlf_state = 0;
-			}
-			if (data.crlf_state == 4) {
-				data.content_offset = offset + i + 1;
-				on_end_header(out, handler);
-				data.crlf_state = -1;
-				break;
+	size_t i = 0;
+	while (i < len) {
+		char const *nl = (char const *)memchr(ptr + i, '\n', len - i);
+		if (!nl) { // 行の途中
+			data.header_line.append(ptr + i, len - i);
+			data.header_bytes += len - i;
+			i = len;
+			break;
+		}
+		size_t n = nl - (ptr + i) + 1;
+		data.header_line.append(ptr + i, n - 1);
+		data.header_bytes += n;
+		i += n;
+		std::string &line = data.header_line;
+		if (!line.empty() && line[line.size() - 1] == '\r') {
+			line.erase(line.size() - 1);
+		}
+		if (line.empty()) {
+			if (data.response.header.empty()) continue; // 先頭の空行は読み飛ばす
+			parse_header(&data.response.header, &data.response);
+			data.header_done = true;
+			if (handler) {
+				handler->checkHeader(this);
 			}
+			break;
 		}
+		data.response.header.push_back(line);
+		line.clear();
 	}
-	if (handler && data.content_offset > 0) {
-		offset = out->size();
-		if (offset > data.content_offset) {
-			size_t len = offset - data.content_offset;
-			char const *ptr = &out->at(data.content_offset);
-			handler->checkContent(ptr, len);
-		}
+	if (!data.header_done && data.header_bytes > 65536) {
+		throw Error("response header too large.");
 	}
+	return i;
 }
 
-#if USE_OPENSSL
-#else
-typedef void SSL;
-#endif
-
-class AutoClose {
-private:
-	socket_t sock;
-	SSL *ssl;
-public:
-	AutoClose(socket_t sock, SSL *ssl = 0)
-		: sock(sock)
-		, ssl(ssl)
-	{
+void WebClient::append_body(char const *ptr, size_t len, WebClientHandler *handler)
+{
+	data.content_bytes += len;
+	if (data.max_content > 0 && data.content_bytes > data.max_content) {
+		throw Error("content too large.");
 	}
-	~AutoClose()
-	{
-#if USE_OPENSSL
-		SSL_shutdown(ssl);
-		closesocket(sock);
-		SSL_free(ssl);
-#else
-		closesocket(sock);
-#endif
+	if (data.store_content) {
+		data.response.content.insert(data.response.content.end(), ptr, ptr + len);
 	}
-};
+	if (handler) {
+		handler->checkContent(ptr, len);
+	}
+}
 
-bool WebClient::http_get(URL const &uri, Post const *post, std::vector<char> *out, WebClientHandler *handler)
+static int remaining_ms(Clock::time_point deadline)
 {
-	clear_error();
-	out->clear();
-
-	socket_t s;
-	struct hostent *servhost;
-	struct sockaddr_in server;
-
-	servhost = gethostbyname(uri.host().c_str());
-	if (!servhost) {
-		throw Error("gethostbyname failed.");
-	}
+	auto d = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+	return d > 0 ? (int)d : 0;
+}
 
-	memset((char *)&server, 0, sizeof(server));
-	server.sin_family = AF_INET;
+static inline bool is_cancelled(std::atomic<bool> const *cancel)
+{
+	return cancel && cancel->load();
+}
 
-	memcpy((char *)&server.sin_addr, servhost->h_addr, servhost->h_length);
+static bool set_nonblocking(socket_t s, bool f)
+{
+#ifdef WIN32
+	u_long arg = f ? 1 : 0;
+	return ioctlsocket(s, FIONBIO, &arg) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	if (flags < 0) return false;
+	flags = f ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	return fcntl(s, F_SETFL, flags) == 0;
+#endif
+}
 
-	server.sin_port = htons(get_port(&uri, "http", "tcp"));
+static bool connect_in_progress()
+{
+#ifdef WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EINPROGRESS;
+#endif
+}
 
-	s = socket(AF_INET, SOCK_STREAM, 0);
-	if (s == INVALID_SOCKET) {
-		throw Error("socket failed.");
+static int socket_error(socket_t s)
+{
+	int err = 0;
+	socklen_t len = sizeof(err);
+	if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char *)&err, &len) != 0) {
+		return -1;
 	}
+	return err;
+}
 
-	if (connect(s, (struct sockaddr*) &server, sizeof(server)) == SOCKET_ERROR) {
-		throw Error("connect failed.");
+// getaddrinfo で得た全アドレスに対して、RFC 8305 (Happy Eyeballs) の要領で
+// 250ms ずつずらしながら並行に接続を試み、最初に確立したものを返す。
+static socket_t connect_(std::string const &host, int port, int timeout_ms, std::atomic<bool> const *cancel)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+	char service[16];
+	sprintf(service, "%d", port);
+	struct addrinfo *res = nullptr;
+	if (getaddrinfo(host.c_str(), service, &hints, &res) != 0 || !res) {
+		throw WebClient::Error("getaddrinfo failed.");
 	}
 
-	AutoClose autoclose(s);
-
-	set_default_headers(uri, post);
-
-	std::string request = make_http_request(uri, post);
+	// 先頭のアドレスファミリと、もう一方を交互に並べる
+	std::vector<struct addrinfo const *> primary;
+	std::vector<struct addrinfo const *> secondary;
+	for (struct addrinfo const *p = res; p; p = p->ai_next) {
+		if (p->ai_family == res->ai_family) {
+			primary.push_back(p);
+		} else {
+			secondary.push_back(p);
+		}
+	}
+	std::vector<struct addrinfo const *> addrs;
+	for (size_t i = 0; i < primary.size() || i < secondary.size(); i++) {
+		if (i < primary.size()) addrs.push_back(primary[i]);
+		if (i < secondary.size()) addrs.push_back(secondary[i]);
+	}
 
-	send_(s, request.c_str(), (int)request.size());
-	if (post && !post->data.empty()) {
-		send_(s, (char const *)&post->data[0], (int)post->data.size());
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+	Clock::time_point next_attempt = Clock::now();
+	std::vector<socket_t> pending;
+	socket_t connected = INVALID_SOCKET;
+	std::string error = "connect failed.";
+	size_t index = 0;
+	while (1) {
+		if (is_cancelled(cancel)) {
+			error = "cancelled.";
+			break;
+		}
+		Clock::time_point now = Clock::now();
+		if (now >= deadline) {
+			error = "connect timed out.";
+			break;
+		}
+		if (index < addrs.size() && (now >= next_attempt || pending.empty())) {
+			struct addrinfo const *ai = addrs[index++];
+			next_attempt = now + std::chrono::milliseconds(250);
+			socket_t s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if (s == INVALID_SOCKET) continue;
+			if (set_nonblocking(s, true)) {
+				if (connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) {
+					connected = s;
+					break;
+				}
+				if (connect_in_progress()) {
+					pending.push_back(s);
+					continue;
+				}
+			}
+			closesocket(s);
+			continue;
+		}
+		if (pending.empty()) break; // すべて失敗
+
+		fd_set wfds;
+		fd_set efds;
+		FD_ZERO(&wfds);
+		FD_ZERO(&efds);
+		socket_t maxfd = 0;
+		for (socket_t s : pending) {
+			FD_SET(s, &wfds);
+			FD_SET(s, &efds);
+			maxfd = std::max(maxfd, s);
+		}
+		Clock::time_point until = std::min(deadline, now + std::chrono::milliseconds(100)); // キャンセルを見るため細かく刻む
+		if (index < addrs.size()) {
+			until = std::min(until, next_attempt);
+		}
+		int ms = remaining_ms(until);
+		struct timeval tv;
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+		int n = select((int)maxfd + 1, nullptr, &wfds, &efds, &tv);
+		if (n < 0) {
+#ifndef WIN32
+			if (errno == EINTR) continue;
+#endif
+			break;
+		}
+		if (n == 0) continue;
+		for (auto it = pending.begin(); it != pending.end(); ) {
+			socket_t s = *it;
+			if (FD_ISSET(s, &wfds) || FD_ISSET(s, &efds)) {
+				it = pending.erase(it);
+				if (connected == INVALID_SOCKET && socket_error(s) == 0) {
+					connected = s;
+				} else {
+					closesocket(s);
+				}
+			} else {
+				it++;
+			}
+		}
+		if (connected != INVALID_SOCKET) break;
+		if (pending.empty()) {
+			next_attempt = now; // 失敗したら待たずに次のアドレスへ
+		}
 	}
+	for (socket_t s : pending) {
+		closesocket(s);
+	}
+	freeaddrinfo(res);
 
-	data.crlf_state = 0;
-	data.content_offset = 0;
+	if (connected == INVALID_SOCKET) {
+		throw WebClient::Error(error);
+	}
+	set_nonblocking(connected, false);
+	return connected;
+}
 
+// ソケットが読み書き可能になるまで待つ。キャンセルと期限を 100ms ごとに確かめる。
+static void wait_socket(socket_t s, bool write, Clock::time_point deadline, std::atomic<bool> const *cancel, char const *timeout_message)
+{
 	while (1) {
-		char buf[4096];
-		int n = recv(s, buf, sizeof(buf), 0);
-		if (n < 1) break;
-		append(buf, n, out, handler);
+		if (is_cancelled(cancel)) {
+			throw WebClient::Error("cancelled.");
+		}
+		int ms = remaining_ms(deadline);
+		if (ms <= 0) {
+			throw WebClient::Error(timeout_message);
+		}
+		ms = std::min(ms, 100);
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(s, &fds);
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = ms * 1000;
+		int n = select((int)s + 1, write ? nullptr : &fds, write ? &fds : nullptr, nullptr, &tv);
+		if (n < 0) {
+#ifndef WIN32
+			if (errno == EINTR) continue;
+#endif
+			throw WebClient::Error("select failed.");
+		}
+		if (n > 0) return;
 	}
+}
 
-	return true;
+// 受信可能になるまで待ってから recv する。無通信が timeout_ms 続いたら失敗とする。
+static int recv_(socket_t s, char *ptr, int len, int timeout_ms, std::atomic<bool> const *cancel)
+{
+	wait_socket(s, false, Clock::now() + std::chrono::milliseconds(timeout_ms), cancel, "read timed out.");
+	return recv(s, ptr, len, 0);
 }
 
 #if USE_OPENSSL
-static void ssend_(SSL *ssl, char const *ptr, int len)
+// TLS の読み書きは非ブロッキングのソケットで行い、WANT_READ/WANT_WRITE のたびに待つ
+static int ssl_read_(SSL *ssl, socket_t s, char *ptr, int len, int timeout_ms, std::atomic<bool> const *cancel)
 {
-	while (len > 0) {
-		int n = SSL_write(ssl, ptr, len);
-		if (n < 1 || n > len) {
-			throw WebClient::Error(get_ssl_error());
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+	while (1) {
+		int n = SSL_read(ssl, ptr, len);
+		if (n > 0) return n;
+		int e = SSL_get_error(ssl, n);
+		if (e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) {
+			wait_socket(s, e == SSL_ERROR_WANT_WRITE, deadline, cancel, "read timed out.");
+			continue;
 		}
-		ptr += n;
-		len -= n;
+		return e == SSL_ERROR_ZERO_RETURN ? 0 : -1;
 	}
 }
 
-void get_strings(X509_NAME *x509name, std::vector<std::string> *out)
+static void ssl_write_(SSL *ssl, socket_t s, char const *ptr, int len, int timeout_ms, std::atomic<bool> const *cancel)
 {
-	out->clear();
-	if (x509name) {
-		int n = X509_NAME_entry_count(x509name);
-		for (int i = 0; i < n; i++) {
-			X509_NAME_ENTRY *entry = X509_NAME_get_entry(x509name, i);
-			ASN1_STRING *asn1str = X509_NAME_ENTRY_get_data(entry);
-			int asn1len = ASN1_STRING_length(asn1str);
-			unsigned char *p = ASN1_STRING_data(asn1str);
-			std::string str((char const *)p, asn1len);
-			out->push_back(str);
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+	while (len > 0) {
+		int n = SSL_write(ssl, ptr, len);
+		if (n > 0) {
+			ptr += n;
+			len -= n;
+			continue;
+		}
+		int e = SSL_get_error(ssl, n);
+		if (e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) {
+			wait_socket(s, e == SSL_ERROR_WANT_WRITE, deadline, cancel, "send timed out.");
+			continue;
 		}
+		throw WebClient::Error(get_ssl_error());
 	}
 }
 #endif
 
+// 接続プールから借りるか新たに接続したソケット。読み残しのバイトを保持する。
+class WebClient::Connection {
+private:
+	WebContext *webcx;
+	std::string key;
+	socket_t sock = INVALID_SOCKET;
+	SSL *ssl = nullptr;
+	bool reused = false;
+	std::vector<char> pending;
+	size_t received = 0;
+	int timeout = 30000;
+	std::atomic<bool> const *cancel = nullptr;
 #if USE_OPENSSL
-void output_debug_strings(std::vector<std::string> const *vec)
-{
-	for (std::vector<std::string>::const_iterator it = vec->begin(); it != vec->end(); it++) {
-		std::string s = *it;
-		s += '\n';
-		OutputDebugStringA(s.c_str());
+	void handshake(std::string const &host, int timeout_ms)
+	{
+		SSL_CTX *ctx = webcx ? webcx->pv->ctx : nullptr;
+		if (!ctx) {
+			throw Error("SSL context is null.");
+		}
+		ssl = SSL_new(ctx);
+		if (!ssl) {
+			throw Error(get_ssl_error());
+		}
+		SSL_set_fd(ssl, (int)sock);
+		if (host.find(':') != std::string::npos) { // IPv6 のアドレスには SNI を送らず、証明書の IP アドレスと照合する
+			X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str());
+		} else {
+			SSL_set_tlsext_host_name(ssl, host.c_str()); // SNI
+			SSL_set1_host(ssl, host.c_str()); // 証明書のホスト名を検証する
+		}
+		SSL_SESSION *sess = webcx->pv->session(key);
+		if (sess) {
+			SSL_set_session(ssl, sess);
+			SSL_SESSION_free(sess);
+		}
+		set_nonblocking(sock, true);
+		Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+		while (1) {
+			int r = SSL_connect(ssl);
+			if (r == 1) break;
+			int e = SSL_get_error(ssl, r);
+			if (e == SSL_ERROR_WANT_READ || e == SSL_ERROR_WANT_WRITE) {
+				wait_socket(sock, e == SSL_ERROR_WANT_WRITE, deadline, cancel, "handshake timed out.");
+				continue;
+			}
+			long v = SSL_get_verify_result(ssl);
+			if (v != X509_V_OK) {
+				throw Error(X509_verify_cert_error_string(v));
+			}
+			throw Error(get_ssl_error());
+		}
+		save_session();
 	}
-}
+	void save_session()
+	{
+		SSL_SESSION *sess = SSL_get_session(ssl);
+		if (sess && SSL_SESSION_is_resumable(sess)) {
+			webcx->pv->set_session(key, sess);
+		}
+	}
+#endif
+public:
+	Connection(WebContext *webcx, std::string const &key)
+		: webcx(webcx)
+		, key(key)
+	{
+	}
+	~Connection()
+	{
+		if (sock != INVALID_SOCKET) {
+			close_connection(sock, ssl);
+		}
+	}
+	void open(std::string const &host, int port, bool tls, int connect_timeout_ms, int read_timeout_ms, std::atomic<bool> const *cancel)
+	{
+		this->timeout = read_timeout_ms;
+		this->cancel = cancel;
+		if (webcx) {
+			sock = webcx->pv->take(key, &ssl);
+		}
+		reused = (sock != INVALID_SOCKET);
+		if (!reused) {
+#if USE_OPENSSL
+			sock = connect_(host, port, connect_timeout_ms, cancel);
+			if (tls) {
+				handshake(host, connect_timeout_ms);
+			}
+#else
+			if (tls) {
+				throw Error("https is not supported.");
+			}
+			sock = connect_(host, port, connect_timeout_ms, cancel);
+#endif
+		}
+	}
+	bool isReused() const
+	{
+		return reused;
+	}
+	size_t receivedBytes() const
+	{
+		return received;
+	}
+	void send(std::string const &str)
+	{
+#if USE_OPENSSL
+		if (ssl) {
+			ssl_write_(ssl, sock, str.c_str(), (int)str.size(), timeout, cancel);
+			return;
+		}
+#endif
+		send_(sock, str.c_str(), (int)str.size());
+	}
+	int read(char *ptr, int len)
+	{
+		int n;
+		if (!pending.empty()) {
+			n = std::min(len, (int)pending.size());
+			memcpy(ptr, &pending[0], n);
+			pending.erase(pending.begin(), pending.begin() + n);
+#if USE_OPENSSL
+		} else if (ssl) {
+			n = ssl_read_(ssl, sock, ptr, len, timeout, cancel);
+#endif
+		} else {
+			n = recv_(sock, ptr, len, timeout, cancel);
+		}
+		if (n > 0) {
+			received += n;
+		}
+		return n;
+	}
+	// 次の応答に属するバイトを戻す
+	void unread(char const *ptr, size_t len)
+	{
+		if (len > 0) {
+			pending.insert(pending.begin(), ptr, ptr + len);
+			received -= len;
+		}
+	}
+	// 応答を読み切った接続をプールに返す
+	void release()
+	{
+		if (webcx && pending.empty() && sock != INVALID_SOCKET) {
+#if USE_OPENSSL
+			if (ssl) {
+				save_session(); // TLS 1.3 ではセッションチケットがハンドシェイク後に届く
+			}
+#endif
+			webcx->pv->put(key, sock, ssl);
+			sock = INVALID_SOCKET;
+			ssl = nullptr;
+		}
+	}
+};
 
-bool WebClient::https_get(URI const &uri, Post const *post, std::vector<char> *out, WebClientHandler *handler)
-{
-#define sslctx() (data.webcx->pv->ctx)
+namespace {
 
-	if (!data.webcx || !data.webcx->pv->ctx) {
-		OutputDebugString("SSL context is null.\n");
-		return false;
+// Transfer-Encoding: chunked の本文を取り出す
+class ChunkedDecoder {
+private:
+	enum State {
+		SIZE,
+		EXTENSION,
+		DATA,
+		DATA_END,
+		TRAILER,
+		DONE,
+	};
+	State state = SIZE;
+	size_t remaining = 0;
+	size_t line_length = 0;
+public:
+	bool done() const
+	{
+		return state == DONE;
 	}
+	// 本文の断片ごとに sink を呼ぶ。消費したバイト数を返す（終端に達したらそこまで）
+	template <typename F> size_t feed(char const *ptr, size_t len, F sink)
+	{
+		size_t i = 0;
+		while (i < len && state != DONE) {
+			int c = ptr[i] & 0xff;
+			switch (state) {
+			case SIZE:
+				if (isxdigit(c)) {
+					if (remaining > (SIZE_MAX >> 4)) { // 桁が多すぎるとあふれて小さな値になる
+						throw WebClient::Error("chunk size too large.");
+					}
+					remaining = remaining * 16 + (isdigit(c) ? (c - '0') : ((c | 0x20) - 'a' + 10));
+				} else if (c == ';' || c == ' ' || c == '\t') {
+					state = EXTENSION;
+				} else if (c == '\n') {
+					state = remaining > 0 ? DATA : TRAILER;
+					line_length = 0;
+				} else if (c != '\r') {
+					throw WebClient::Error("invalid chunk size.");
+				}
+				i++;
+				break;
+			case EXTENSION:
+				if (c == '\n') {
+					state = remaining > 0 ? DATA : TRAILER;
+					line_length = 0;
+				}
+				i++;
+				break;
+			case DATA:
+				{
+					size_t n = std::min(remaining, len - i);
+					sink(ptr + i, n);
+					remaining -= n;
+					i += n;
+					if (remaining == 0) {
+						state = DATA_END;
+					}
+				}
+				break;
+			case DATA_END:
+				if (c == '\n') {
+					state = SIZE;
+				} else if (c != '\r') {
+					throw WebClient::Error("invalid chunk terminator.");
+				}
+				i++;
+				break;
+			case TRAILER:
+				if (c == '\n') {
+					if (line_length == 0) {
+						state = DONE;
+					}
+					line_length = 0;
+				} else if (c != '\r') {
+					line_length++;
+				}
+				i++;
+				break;
+			default:
+				break;
+			}
+		}
+		return i;
+	}
+};
 
-	clear_error();
-	out->clear();
-
-	int ret;
-	socket_t s;
-	struct hostent *servhost;
-	struct sockaddr_in server;
+}
 
-	SSL *ssl;
+#if USE_ZLIB
+namespace {
 
-	servhost = gethostbyname(uri.host().c_str());
-	if (!servhost) {
-		throw Error("gethostbyname failed.");
+// Content-Encoding: gzip/deflate の本文を受信しながら展開する
+class Inflater {
+private:
+	z_stream z;
+	bool active = false;
+	bool done = false;
+	bool raw_fallback = false;
+	size_t fed = 0;
+public:
+	~Inflater()
+	{
+		if (active) {
+			inflateEnd(&z);
+		}
+	}
+	bool begin(std::string const &encoding)
+	{
+		std::string enc;
+		for (char c : encoding) {
+			if (!isspace(c & 0xff)) {
+				enc += (char)tolower(c & 0xff);
+			}
+		}
+		int bits;
+		if (enc == "gzip" || enc == "x-gzip") {
+			bits = 15 + 16;
+		} else if (enc == "deflate") {
+			bits = 15;
+			raw_fallback = true; // zlib 形式でない（生の deflate を送る）サーバがある
+		} else {
+			return false;
+		}
+		memset(&z, 0, sizeof(z));
+		if (inflateInit2(&z, bits) != Z_OK) {
+			throw WebClient::Error("inflateInit failed.");
+		}
+		active = true;
+		return true;
+	}
+	template <typename F> void feed(char const *ptr, size_t len, F sink)
+	{
+		z.next_in = (Bytef *)ptr;
+		z.avail_in = (uInt)len;
+		while (!done) {
+			char out[16384];
+			z.next_out = (Bytef *)out;
+			z.avail_out = sizeof(out);
+			int r = inflate(&z, Z_NO_FLUSH);
+			if (r == Z_DATA_ERROR && raw_fallback && fed == 0 && z.total_out == 0) {
+				raw_fallback = false;
+				inflateEnd(&z);
+				memset(&z, 0, sizeof(z));
+				if (inflateInit2(&z, -15) != Z_OK) {
+					active = false;
+					throw WebClient::Error("inflateInit failed.");
+				}
+				z.next_in = (Bytef *)ptr;
+				z.avail_in = (uInt)len;
+				continue;
+			}
+			if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+				throw WebClient::Error("inflate failed.");
+			}
+			size_t n = sizeof(out) - z.avail_out;
+			if (n > 0) {
+				sink(out, n);
+			}
+			if (r == Z_STREAM_END) {
+				done = true;
+			}
+			if (z.avail_in == 0 && z.avail_out != 0) break;
+			if (r == Z_BUF_ERROR) break;
+		}
+		fed += len;
 	}
+};
 
-	memset((char *)&server, 0, sizeof(server));
-	server.sin_family = AF_INET;
+}
+#endif
 
-	memcpy((char *)&server.sin_addr, servhost->h_addr, servhost->h_length);
+static bool header_contains_token(std::string const &value, char const *token)
+{
+	std::string s = value;
+	std::transform(s.begin(), s.end(), s.begin(), [](char c){ return (char)tolower(c & 0xff); });
+	return s.find(token) != std::string::npos;
+}
 
-	server.sin_port = htons(get_port(&uri, "https", "tcp"));
+bool WebClient::read_response(Connection *conn, bool head, WebClientHandler *handler)
+{
+	begin_response();
 
-	s = socket(AF_INET, SOCK_STREAM, 0);
-	if (s == INVALID_SOCKET) {
-		throw Error("socket failed.");
+	char buf[16384];
+	while (!data.header_done) {
+		int n = conn->read(buf, sizeof(buf));
+		if (n < 1) {
+			throw Error("connection closed.");
+		}
+		size_t used = append_header(buf, n, handler);
+		conn->unread(buf + used, n - used);
 	}
 
-	if (connect(s, (struct sockaddr*) &server, sizeof(server)) == SOCKET_ERROR) {
-		throw Error("connect failed.");
+	Response const &r = data.response;
+	bool keepalive;
+	if (r.version.hi == 1 && r.version.lo == 0) {
+		keepalive = header_contains_token(header_value("Connection"), "keep-alive");
+	} else {
+		keepalive = !header_contains_token(header_value("Connection"), "close");
 	}
 
-	ssl = SSL_new(sslctx());
-	if (!ssl) {
-		throw Error(get_ssl_error());
+	if (head || r.code == 204 || r.code == 304 || r.code / 100 == 1) {
+		return keepalive; // 本文なし
 	}
 
-	SSL_set_options(ssl, SSL_OP_NO_SSLv2);
-	SSL_set_options(ssl, SSL_OP_NO_SSLv3);
-
-	ret = SSL_set_fd(ssl, s);
-	if (ret == 0) {
-		throw Error(get_ssl_error());
+	// 圧縮されていれば展開してから append_body() に渡す。サイズの制限は展開後の量にかかる
+#if USE_ZLIB
+	Inflater inflater;
+	bool compressed = inflater.begin(header_value("Content-Encoding"));
+#endif
+	auto Deliver = [&](char const *p, size_t len){
+#if USE_ZLIB
+		if (compressed) {
+			inflater.feed(p, len, [&](char const *q, size_t n){
+				append_body(q, n, handler);
+			});
+			return;
+		}
+#endif
+		append_body(p, len, handler);
+	};
+
+	if (header_contains_token(header_value("Transfer-Encoding"), "chunked")) {
+		ChunkedDecoder decoder;
+		while (!decoder.done()) {
+			int n = conn->read(buf, sizeof(buf));
+			if (n < 1) {
+				throw Error("connection closed in chunked body.");
+			}
+			size_t used = decoder.feed(buf, n, [&](char const *p, size_t len){
+				Deliver(p, len);
+			});
+			conn->unread(buf + used, n - used);
+		}
+		return keepalive;
 	}
 
-	RAND_poll();
-	while (RAND_status() == 0) {
-		unsigned short rand_ret = rand() % 65536;
-		RAND_seed(&rand_ret, sizeof(rand_ret));
+	std::string cl = header_value("Content-Length");
+	if (!cl.empty()) {
+		unsigned long long remaining = strtoull(cl.c_str(), nullptr, 10);
+		if (data.store_content) {
+			data.response.content.reserve((size_t)std::min<unsigned long long>(remaining, 16 * 1024 * 1024));
+		}
+		while (remaining > 0) {
+			int n = conn->read(buf, (int)std::min<unsigned long long>(remaining, sizeof(buf)));
+			if (n < 1) {
+				throw Error("connection closed before end of content.");
+			}
+			Deliver(buf, n);
+			remaining -= n;
+		}
+		return keepalive;
 	}
 
-	ret = SSL_connect(ssl);
-	if (ret != 1) {
-		throw Error(get_ssl_error());
+	// 長さ不明。切断まで読む
+	while (1) {
+		int n = conn->read(buf, sizeof(buf));
+		if (n < 1) break;
+		Deliver(buf, n);
 	}
+	return false;
+}
 
-	AutoClose autoclose(s, ssl);
-
-	std::string cipher = SSL_get_cipher(ssl);
-	cipher += '\n';
-	OutputDebugString(cipher.c_str());
+std::string WebClient::connection_key(URL const &uri, int port)
+{
+	return uri.scheme() + "://" + uri.host() + ':' + to_s(port);
+}
 
-	std::string version = SSL_get_cipher_version(ssl);
-	version += '\n';
-	OutputDebugString(version.c_str());
+bool WebClient::http_get(URL const &uri, Post const *post, WebClientHandler *handler, std::vector<std::string> const *extra)
+{
+	clear_error();
 
-	X509 *x509 = SSL_get_peer_certificate(ssl);
-	if (x509) {
-		std::string fingerprint;
-		for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-			if (i > 0) {
-				fingerprint += ':';
+	if (!uri.isValid()) {
+		throw Error("invalid url.");
+	}
+	int port = get_port(&uri, uri.isssl() ? "https" : "http", "tcp");
+	std::string request = make_http_request(uri, post, extra);
+	for (int attempt = 0; ; attempt++) {
+		Connection conn(data.webcx, connection_key(uri, port));
+		conn.open(uri.host(), port, uri.isssl(), data.connect_timeout, data.read_timeout, data.cancel);
+		try {
+			conn.send(request);
+			if (read_response(&conn, data.head && !post, handler)) {
+				conn.release();
+			}
+		} catch (Error const &) {
+			// プールの接続がサーバ側で既に閉じられていた場合は一度だけやり直す
+			if (attempt == 0 && conn.isReused() && conn.receivedBytes() == 0) {
+				continue;
 			}
-			char tmp[10];
-			sprintf(tmp, "%02X", x509->sha1_hash[i]);
-			fingerprint += tmp;
+			throw;
 		}
-		fingerprint += '\n';
-		OutputDebugString(fingerprint.c_str());
-
+		return true;
+	}
+}
 
-		long l = SSL_get_verify_result(ssl);
-		if (l == X509_V_OK) {
-			// ok
-		} else {
-			// wrong
-			std::string err = X509_verify_cert_error_string(l);
-			err += '\n';
-			OutputDebugString(err.c_str());
-		}
+namespace {
 
-		std::vector<std::string> vec;
+// ディスク上の HTTP キャッシュの一件。先頭に URL と保存時刻、続いて応答ヘッダと本文を置く
+struct CacheEntry {
+	long long stored = 0;
+	std::vector<std::string> header;
+	std::vector<char> content;
+};
 
-		X509_NAME *subject = X509_get_subject_name(x509);
-		get_strings(subject, &vec);
-		OutputDebugString("--- subject ---\n");
-		output_debug_strings(&vec);
+char const CACHE_MAGIC[] = "HTTPCache 1";
 
-		X509_NAME *issuer = X509_get_issuer_name(x509);
-		get_strings(issuer, &vec);
-		OutputDebugString("--- issuer ---\n");
-		output_debug_strings(&vec);
+std::string cache_path(std::string const &dir, std::string const &url)
+{
+	unsigned long long h = 14695981039346656037ULL; // FNV-1a
+	for (char c : url) {
+		h = (h ^ (unsigned char)c) * 1099511628211ULL;
+	}
+	char tmp[32];
+	sprintf(tmp, "%016llx.cache", h);
+	std::string path = dir;
+	if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\') {
+		path += '/';
+	}
+	return path + tmp;
+}
 
-		ASN1_TIME *not_before = X509_get_notBefore(x509);
-		ASN1_TIME *not_after  = X509_get_notAfter(x509);
+bool read_line(FILE *fp, std::string *out)
+{
+	out->clear();
+	int c;
+	while ((c = getc(fp)) != EOF && c != '\n') {
+		*out += (char)c;
+	}
+	return c != EOF;
+}
 
-		X509_free(x509);
-	} else {
-		// wrong
+bool load_cache(std::string const &path, std::string const &url, CacheEntry *out)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (!fp) return false;
+	bool ok = false;
+	std::string line;
+	if (read_line(fp, &line) && line == CACHE_MAGIC && read_line(fp, &line) && line == url && read_line(fp, &line)) {
+		out->stored = strtoll(line.c_str(), nullptr, 10);
+		while (read_line(fp, &line) && !line.empty()) {
+			out->header.push_back(line);
+		}
+		char buf[16384];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+			out->content.insert(out->content.end(), buf, buf + n);
+		}
+		ok = !out->header.empty();
 	}
+	fclose(fp);
+	return ok;
+}
 
-	set_default_headers(uri, post);
+void save_cache(std::string const &path, std::string const &url, CacheEntry const &entry)
+{
+	std::string tmp = path + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "wb");
+	if (!fp) return;
+	fprintf(fp, "%s\n%s\n%lld\n", CACHE_MAGIC, url.c_str(), entry.stored);
+	for (std::string const &line : entry.header) {
+		fprintf(fp, "%s\n", line.c_str());
+	}
+	fputc('\n', fp);
+	if (!entry.content.empty()) {
+		fwrite(&entry.content[0], 1, entry.content.size(), fp);
+	}
+	bool ok = (ferror(fp) == 0);
+	fclose(fp);
+	remove(path.c_str());
+	if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+		remove(tmp.c_str());
+	}
+}
 
-	std::string request = make_http_request(uri, post);
+std::string lower(std::string s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), [](char c){ return (char)tolower(c & 0xff); });
+	return s;
+}
 
-	ssend_(ssl, request.c_str(), (int)request.size());
-	if (post && !post->data.empty()) {
-		ssend_(ssl, (char const *)&post->data[0], (int)post->data.size());
+// 途中の応答（再検証で返った 304 と、たどる予定のリダイレクト）は呼び出し元に見せず、本文も中で読み捨てる。
+// 呼び出し元には最後の応答だけが渡る。304 の後はキャッシュの内容を 200 として渡し直す
+class IntermediateFilter : public WebClientHandler {
+private:
+	WebClientHandler *handler_;
+	bool hide_not_modified_;
+	bool hide_redirect_;
+	bool pass_ = true;
+public:
+	IntermediateFilter(WebClientHandler *handler, bool hide_not_modified, bool hide_redirect)
+		: handler_(handler)
+		, hide_not_modified_(hide_not_modified)
+		, hide_redirect_(hide_redirect)
+	{
+	}
+	void checkHeader(WebClient *wc)
+	{
+		int code = wc->response()->code;
+		bool hidden = (hide_not_modified_ && code == 304) ||
+				(hide_redirect_ && WebClient::is_redirect(code) && !wc->header_value("Location").empty());
+		pass_ = !hidden;
+		if (pass_) {
+			handler_->checkHeader(wc);
+		}
 	}
+	void checkContent(char const *ptr, size_t len)
+	{
+		if (pass_) {
+			handler_->checkContent(ptr, len);
+		}
+	}
+};
+
+// Cache-Control: max-age の秒数。指定がなければ 0
+long long max_age(std::string const &cache_control)
+{
+	std::string s = lower(cache_control);
+	size_t i = s.find("max-age=");
+	if (i == std::string::npos) return 0;
+	return strtoll(s.c_str() + i + 8, nullptr, 10);
+}
 
-	data.crlf_state = 0;
-	data.content_offset = 0;
+}
 
-	while (1) {
-		char buf[4096];
-		int n = SSL_read(ssl, buf, sizeof(buf));
-		if (n < 1) break;
-		append(buf, n, out, handler);
+bool WebClient::is_redirect(int code)
+{
+	return code == 301 || code == 302 || code == 303 || code == 307 || code == 308;
+}
+
+// キャッシュが新しければそれを返し、古ければ条件付きで取得する
+void WebClient::cached_get(URL const &uri, Post const *post, WebClientHandler *handler)
+{
+	// Range などの要求ヘッダで応答が変わるので、キーにはそれも含める
+	std::string url = uri.str();
+	for (std::string const &h : data.request_headers) {
+		url += '\t' + h;
 	}
+	std::string path;
+	if (!post && !data.head && data.webcx && !data.webcx->pv->cache_dir.empty()) {
+		path = cache_path(data.webcx->pv->cache_dir, url);
+	}
+	CacheEntry entry;
+	bool cached = !path.empty() && load_cache(path, url, &entry);
+	long long now = (long long)time(nullptr);
+
+	auto Serve = [&](){
+		data.response = Response();
+		data.response.header = entry.header;
+		parse_header(&data.response.header, &data.response);
+		if (handler) {
+			handler->checkHeader(this);
+		}
+		data.response.content = entry.content;
+		if (handler && !entry.content.empty()) {
+			handler->checkContent(&entry.content[0], entry.content.size());
+		}
+	};
+
+	std::vector<std::string> conditions;
+	if (cached) {
+		std::string cc = header_value(&entry.header, "Cache-Control");
+		if (lower(cc).find("no-cache") == std::string::npos && now - entry.stored < max_age(cc)) {
+			Serve(); // まだ新しい
+			return;
+		}
+		std::string etag = header_value(&entry.header, "ETag");
+		if (!etag.empty()) {
+			conditions.push_back("If-None-Match: " + etag);
+		}
+		std::string lm = header_value(&entry.header, "Last-Modified");
+		if (!lm.empty()) {
+			conditions.push_back("If-Modified-Since: " + lm);
+		}
+	}
+
+	IntermediateFilter filter(handler, true, false);
+	http_get(uri, post, cached && handler ? &filter : handler, &conditions);
 
-	return true;
-#undef sslctx
+	if (path.empty()) return;
+	if (cached && data.response.code == 304) {
+		entry.stored = now;
+		save_cache(path, url, entry);
+		Serve();
+		return;
+	}
+	if (data.response.code != 200 || !data.store_content) return;
+	std::string cc = lower(header_value("Cache-Control"));
+	if (cc.find("no-store") != std::string::npos) return;
+	if (header_value("ETag").empty() && header_value("Last-Modified").empty() && max_age(cc) <= 0) return;
+	if (data.response.content.size() > 4 * 1024 * 1024) return;
+	entry = CacheEntry();
+	entry.stored = now;
+	for (std::string const &line : data.response.header) {
+		// 本文は展開済みで保存するので、転送に関するヘッダは残さない
+		std::string name = lower(line.substr(0, line.find(':')));
+		if (name != "content-encoding" && name != "content-length" && name != "transfer-encoding") {
+			entry.header.push_back(line);
+		}
+	}
+	entry.content = data.response.content;
+	save_cache(path, url, entry);
 }
-#endif
 
-void WebClient::get(URL const &uri, Post const *post, Response *out, WebClientHandler *handler)
+void WebClient::get(URL const &uri, Post const *post, WebClientHandler *handler)
 {
-	*out = Response();
 	try {
-		std::vector<char> res;
-		if (uri.isssl()) {
-#if USE_OPENSSL
-			https_get(uri, post, &res, handler);
-#endif
-		} else {
-			http_get(uri, post, &res, handler);
-		}
-		if (!res.empty()) {
-			char const *begin = &res[0];
-			char const *end = begin + res.size();
-			char const *ptr = begin + data.content_offset;
-			if (ptr < end) {
-				out->content.assign(ptr, end);
+		URL url = uri;
+		for (int hops = 0; ; hops++) {
+			data.final_url = url.str();
+			IntermediateFilter filter(handler, false, hops < data.max_redirects);
+			cached_get(url, post, handler ? &filter : nullptr);
+			int code = data.response.code;
+			if (!is_redirect(code) || hops >= data.max_redirects) break;
+			std::string location = header_value("Location");
+			if (location.empty()) break;
+			url = URL(url.resolve(location).c_str());
+			if (code != 307 && code != 308) {
+				post = nullptr; // 303 などは GET でたどる
 			}
 		}
 		return;
@@ -589,7 +1326,7 @@ void WebClient::get(URL const &uri, Post const *post, Response *out, WebClientHa
 			data.error = e;
 		}
 	}
-	*out = Response();
+	data.response = Response();
 }
 
 void WebClient::parse_header(std::vector<std::string> const *header, WebClient::Response *res)
@@ -691,6 +1428,11 @@ std::string WebClient::content_type() const
 	return s;
 }
 
+std::string const &WebClient::final_url() const
+{
+	return data.final_url;
+}
+
 size_t WebClient::content_length() const
 {
 	return data.response.content.size();
@@ -704,21 +1446,123 @@ char const *WebClient::content_data() const
 
 int WebClient::get(URL const &uri, WebClientHandler *handler)
 {
-	get(uri, 0, &data.response, handler);
+	data.response = Response();
+	get(uri, 0, handler);
+	return data.response.code;
+}
+
+int WebClient::head(URL const &uri, WebClientHandler *handler)
+{
+	data.response = Response();
+	data.head = true;
+	get(uri, 0, handler);
+	data.head = false;
 	return data.response.code;
 }
 
 int WebClient::post(URL const &uri, Post const *post, WebClientHandler *handler)
 {
-	get(uri, post, &data.response, handler);
+	data.response = Response();
+	get(uri, post, handler);
 	return data.response.code;
 }
 
+// 同じ接続先への要求は応答を待たずに続けて送る（HTTP/1.1 のパイプライン）。
+// リダイレクトはたどらず、キャッシュも使わない。失敗した要求の応答は空のままにする
+void WebClient::get_all(std::vector<URL> const &uris, std::vector<Response> *out, WebClientHandler *handler)
+{
+	clear_error();
+	out->clear();
+	out->resize(uris.size());
+
+	// 接続先ごとにまとめる
+	std::map<std::string, std::vector<size_t>> groups;
+	for (size_t i = 0; i < uris.size(); i++) {
+		URL const &uri = uris[i];
+		if (!uri.isValid()) continue;
+		groups[connection_key(uri, get_port(&uri, uri.isssl() ? "https" : "http", "tcp"))].push_back(i);
+	}
+
+	int const depth = 8; // 応答を待たずに送る要求の最大数
+	for (auto const &pair : groups) {
+		std::vector<size_t> const &indexes = pair.second;
+		URL const &first = uris[indexes.front()];
+		int port = get_port(&first, first.isssl() ? "https" : "http", "tcp");
+		size_t next = 0;
+		bool retried = false;
+		while (next < indexes.size()) {
+			Connection conn(data.webcx, pair.first);
+			try {
+				conn.open(first.host(), port, first.isssl(), data.connect_timeout, data.read_timeout, data.cancel);
+			} catch (Error const &e) {
+				data.error = e; // 接続できなければ残りもすべて失敗
+				break;
+			}
+			size_t sent = next;
+			try {
+				bool keepalive = true;
+				while (keepalive && next < indexes.size()) {
+					while (sent < indexes.size() && sent - next < (size_t)depth) {
+						conn.send(make_http_request(uris[indexes[sent]], nullptr));
+						sent++;
+					}
+					keepalive = read_response(&conn, false, handler);
+					(*out)[indexes[next]] = std::move(data.response);
+					next++;
+				}
+				if (keepalive) {
+					conn.release();
+				}
+				// keep-alive でなければ残りを新しい接続で送り直す
+			} catch (Error const &e) {
+				if (is_cancelled(data.cancel)) {
+					data.error = e;
+					break;
+				}
+				if (!retried && conn.isReused() && conn.receivedBytes() == 0) {
+					retried = true;
+					continue;
+				}
+				data.error = e;
+				(*out)[indexes[next]] = Response(); // この要求は失敗として次へ
+				next++;
+			}
+		}
+	}
+	data.response = Response();
+}
+
 void WebClient::add_header(std::string const &text)
 {
 	data.request_headers.push_back(text);
 }
 
+void WebClient::set_timeout(int connect_ms, int read_ms)
+{
+	data.connect_timeout = connect_ms;
+	data.read_timeout = read_ms;
+}
+
+void WebClient::set_cancel_flag(std::atomic<bool> const *flag)
+{
+	data.cancel = flag;
+}
+
+void WebClient::set_store_content(bool f)
+{
+	data.store_content = f;
+}
+
+void WebClient::set_max_content(size_t bytes)
+{
+	data.max_content = bytes;
+}
+
+void WebClient::set_max_redirects(int n)
+{
+	data.max_redirects = n < 0 ? 0 : n;
+}
+
 WebClient::Response const *WebClient::response() const
 {
 	return &data.response;
@@ -732,24 +1576,110 @@ WebContext::WebContext()
 #if USE_OPENSSL
 	SSL_load_error_strings();
 	SSL_library_init();
-	pv->ctx = SSL_CTX_new(SSLv23_client_method());
+	pv->ctx = SSL_CTX_new(TLS_client_method());
+	if (pv->ctx) {
+		SSL_CTX_set_default_verify_paths(pv->ctx); // システムの証明書ストア
+		SSL_CTX_set_verify(pv->ctx, SSL_VERIFY_PEER, nullptr);
+		SSL_CTX_set_session_cache_mode(pv->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	}
 #endif
 }
 
 WebContext::~WebContext()
 {
+	pv->clear();
 #if USE_OPENSSL
+	for (auto &pair : pv->sessions) {
+		SSL_SESSION_free(pair.second);
+	}
 	SSL_CTX_free(pv->ctx);
 #endif
 	delete pv;
 }
 
+void WebContext::set_cache_dir(std::string const &dir)
+{
+	pv->cache_dir = dir;
+}
+
 #if USE_OPENSSL
 bool WebContext::load_crt(char const *path)
 {
-	// path = "C:\\develop\\httpsget\\ca-bundle.crt";
 	int r = SSL_CTX_load_verify_locations(pv->ctx, path, 0);
 	return r == 1;
 }
 #endif
 
+
+socket_t WebContext::Private::take(std::string const &key, SSL **ssl)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = idle.find(key);
+	if (it == idle.end()) return INVALID_SOCKET;
+	std::vector<IdleSocket> *vec = &it->second;
+	while (!vec->empty()) {
+		IdleSocket item = vec->back();
+		vec->pop_back();
+		if (Clock::now() - item.since < std::chrono::seconds(30)) {
+			// 待機中に読めるものがあるなら、サーバが閉じたか不正な応答なので使わない
+			fd_set rfds;
+			FD_ZERO(&rfds);
+			FD_SET(item.sock, &rfds);
+			struct timeval tv = { 0, 0 };
+			if (select((int)item.sock + 1, &rfds, nullptr, nullptr, &tv) == 0) {
+				*ssl = item.ssl;
+				return item.sock;
+			}
+		}
+		close_connection(item.sock, item.ssl);
+	}
+	return INVALID_SOCKET;
+}
+
+void WebContext::Private::put(std::string const &key, socket_t sock, SSL *ssl)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<IdleSocket> *vec = &idle[key];
+	if (vec->size() >= 4) {
+		close_connection(vec->front().sock, vec->front().ssl);
+		vec->erase(vec->begin());
+	}
+	IdleSocket item;
+	item.sock = sock;
+	item.ssl = ssl;
+	item.since = Clock::now();
+	vec->push_back(item);
+}
+
+void WebContext::Private::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &pair : idle) {
+		for (IdleSocket const &item : pair.second) {
+			close_connection(item.sock, item.ssl);
+		}
+	}
+	idle.clear();
+}
+
+#if USE_OPENSSL
+SSL_SESSION *WebContext::Private::session(std::string const &key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = sessions.find(key);
+	if (it == sessions.end()) return nullptr;
+	SSL_SESSION_up_ref(it->second);
+	return it->second;
+}
+
+void WebContext::Private::set_session(std::string const &key, SSL_SESSION *sess)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	SSL_SESSION_up_ref(sess);
+	SSL_SESSION *&slot = sessions[key];
+	if (slot) {
+		SSL_SESSION_free(slot);
+	}
+	slot = sess;
+}
+#endif
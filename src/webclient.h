@@ -2,10 +2,17 @@
 #ifndef __WebClient_h
 #define __WebClient_h
 
+#include <atomic>
 #include <vector>
 #include <string>
 
-#define USE_OPENSSL 0
+#ifndef USE_OPENSSL
+#define USE_OPENSSL 1
+#endif
+
+#ifndef USE_ZLIB
+#define USE_ZLIB 1
+#endif
 
 class WebContext;
 class WebClient;
@@ -20,12 +27,14 @@ public:
 	virtual void checkHeader(WebClient * /*wc*/)
 	{
 	}
+	// 本文を受信するたびに、新しく届いた部分だけが渡される
 	virtual void checkContent(char const * /*ptr*/, size_t /*len*/)
 	{
 	}
 };
 
 class WebClient {
+	friend struct ParserHarness;
 public:
 	class URL {
 	private:
@@ -37,9 +46,13 @@ public:
 		URL(char const *str);
 		std::string const &scheme() const { return scheme_; }
 		std::string const &host() const { return host_; }
+		std::string host_literal() const;
 		int port() const { return port_; }
 		std::string const &path() const { return path_; }
+		bool isValid() const { return !host_.empty(); }
 		bool isssl() const;
+		std::string str() const;
+		std::string resolve(std::string const &location) const;
 	};
 
 	class Error {
@@ -80,24 +93,33 @@ private:
 		Error error;
 		Response response;
 		WebContext *webcx;
-		int crlf_state = 0;
-		size_t content_offset;
+		std::string header_line;
+		size_t header_bytes = 0;
+		bool header_done = false;
+		bool store_content = true;
+		size_t content_bytes = 0;
+		size_t max_content = 64 * 1024 * 1024; // 展開後の本文の上限（0 なら無制限）
+		int max_redirects = 5;
+		std::string final_url;
+		bool head = false;
+		int connect_timeout = 10000; // ms
+		int read_timeout = 30000; // ms
+		std::atomic<bool> const *cancel = nullptr;
 	} data;
 	void clear_error();
 	static int get_port(URL const *uri, char const *scheme, char const *protocol);
-	void set_default_headers(URL const &uri, Post const *post);
-	std::string make_http_request(URL const &uri, Post const *post);
-	void parse_http_header(char const *begin, char const *end, std::vector<std::string> *header);
-	void parse_http_header(char const *begin, char const *end, Response *out);
-	bool http_get(URL const &uri, Post const *post, std::vector<char> *out, WebClientHandler *handler);
-#if USE_OPENSSL
-	bool https_get(URI const &uri, Post const *post, std::vector<char> *out, WebClientHandler *handler);
-#endif
-	void get(URL const &uri, Post const *post, Response *out, WebClientHandler *handler);
+	class Connection;
+	static std::string connection_key(URL const &uri, int port);
+	static void set_default_headers(URL const &uri, Post const *post, std::vector<std::string> *out);
+	std::string make_http_request(URL const &uri, Post const *post, std::vector<std::string> const *extra = nullptr);
+	void begin_response();
+	bool read_response(Connection *conn, bool head, WebClientHandler *handler);
+	bool http_get(URL const &uri, Post const *post, WebClientHandler *handler, std::vector<std::string> const *extra = nullptr);
+	void cached_get(URL const &uri, Post const *post, WebClientHandler *handler);
+	void get(URL const &uri, Post const *post, WebClientHandler *handler);
 	static void parse_header(std::vector<std::string> const *header, WebClient::Response *res);
-	static std::string header_value(std::vector<std::string> const *header, const std::string &name);
-	void append(const char *ptr, size_t len, std::vector<char> *out, WebClientHandler *handler);
-	void on_end_header(const std::vector<char> *vec, WebClientHandler *handler);
+	size_t append_header(const char *ptr, size_t len, WebClientHandler *handler);
+	void append_body(const char *ptr, size_t len, WebClientHandler *handler);
 public:
 	static void initialize();
 	WebClient(WebContext *webcx)
@@ -109,11 +131,21 @@ public:
 	}
 	Error const &error() const;
 	int get(URL const &uri, WebClientHandler *handler = 0);
+	int head(URL const &uri, WebClientHandler *handler = 0);
 	int post(URL const &uri, Post const *post, WebClientHandler *handler = 0);
+	void get_all(std::vector<URL> const &uris, std::vector<Response> *out, WebClientHandler *handler = 0);
 	void add_header(std::string const &text);
+	void set_timeout(int connect_ms, int read_ms);
+	void set_cancel_flag(std::atomic<bool> const *flag);
+	void set_store_content(bool f); // false なら本文を保持せず checkContent() に渡すだけにする
+	void set_max_content(size_t bytes);
+	void set_max_redirects(int n);
 	Response const *response() const;
 	std::string header_value(std::string const &name) const;
+	static std::string header_value(std::vector<std::string> const *header, const std::string &name);
+	static bool is_redirect(int code);
 	std::string content_type() const;
+	std::string const &final_url() const; // リダイレクトをたどった後の URL
 	size_t content_length() const;
 	const char *content_data() const;
 };
@@ -129,6 +161,8 @@ public:
 	WebContext();
 	~WebContext();
 
+	void set_cache_dir(std::string const &dir); // 空でなければ GET の応答をここにキャッシュする
+
 #if USE_OPENSSL
 	bool load_crt(char const *path);
 #endif
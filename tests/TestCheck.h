@@ -0,0 +1,32 @@
+#ifndef TESTCHECK_H
+#define TESTCHECK_H
+
+#include <stdio.h>
+
+// 失敗しても止めずに数えておき、main の最後で testResult() を返す
+inline int &testFailures()
+{
+	static int n = 0;
+	return n;
+}
+
+inline int testResult()
+{
+	int n = testFailures();
+	if (n > 0) {
+		fprintf(stderr, "%d check(s) failed\n", n);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
+
+#define CHECK(EXPR) \
+	do { \
+		if (!(EXPR)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #EXPR); \
+			testFailures()++; \
+		} \
+	} while (0)
+
+#endif // TESTCHECK_H
@@ -0,0 +1,83 @@
+// 解析関数の結果。入力は手で書いた小さな応答で、件数と中身を確かめる
+
+#include "ApplicationGlobal.h"
+#include "TestCheck.h"
+#include "ParserHarness.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+ApplicationGlobal *global = nullptr;
+
+namespace {
+
+// 新しい MPD は曲ごとに duration: や format: のような小文字の属性を送ってくる。
+// file の項目の中ではこれらを属性として扱い、file: / directory: / playlist: だけが次の項目の始まりになる
+void test_mpd_lowercase_attributes()
+{
+	QStringList lines;
+	lines << "file: Artist/Album/01 - A.flac"
+		<< "Last-Modified: 2020-01-01T00:00:00Z"
+		<< "duration: 180.000"
+		<< "format: 44100:16:2"
+		<< "Title: A"
+		<< "file: Artist/Album/02 - B.flac"
+		<< "duration: 200.500"
+		<< "Title: B"
+		<< "directory: Artist/Other"
+		<< "playlist: Artist/list.m3u";
+	MusicPlayerClient mpc;
+	QList<MusicPlayerClient::Item> items;
+	ParserHarness::mpdParse(&mpc, lines, &items);
+	CHECK(items.size() == 4);
+	if (items.size() != 4) return;
+	CHECK(items[0].kind == "file");
+	CHECK(items[0].text == "Artist/Album/01 - A.flac");
+	CHECK(items[0].map.get("duration") == "180.000");
+	CHECK(items[0].map.get("format") == "44100:16:2");
+	CHECK(items[0].map.get("Title") == "A");
+	CHECK(items[1].kind == "file");
+	CHECK(items[1].map.get("duration") == "200.500");
+	CHECK(items[1].map.get("Title") == "B");
+	CHECK(items[2].kind == "directory");
+	CHECK(items[2].text == "Artist/Other");
+	CHECK(items[3].kind == "playlist");
+}
+
+// FileN の N の順に並べ、同じ N の行はまとめて 1 件にする。同じ項目が重なれば後のものを使う
+void test_pls_order()
+{
+	char const pls[] =
+		"[playlist]\n"
+		"File3=http://example.com/c.mp3\n"
+		"Title1=first\n"
+		"File2147483647=http://example.com/last.mp3\n"
+		"File1=http://example.com/a.mp3\n"
+		"Length1=120\n"
+		"Title3=third\n"
+		"File2=/local/b.mp3\n"
+		"Title1=first (again)\n"
+		"NumberOfEntries=3\n"
+		"Version=2\n";
+	std::vector<PlaylistFile::Item> items;
+	CHECK(ParserHarness::parsePls(pls, pls + sizeof(pls) - 1, &items));
+	CHECK(items.size() == 3); // File2 は http でないので除く
+	if (items.size() != 3) return;
+	CHECK(items[0].file == "http://example.com/a.mp3");
+	CHECK(items[0].title == "first (again)");
+	CHECK(items[0].length == 120);
+	CHECK(items[1].file == "http://example.com/c.mp3");
+	CHECK(items[1].title == "third");
+	CHECK(items[1].length == -1);
+	CHECK(items[2].file == "http://example.com/last.mp3");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	test_mpd_lowercase_attributes();
+	test_pls_order();
+	return testResult();
+}
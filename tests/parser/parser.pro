@@ -0,0 +1,31 @@
+include(../tests.pri)
+
+TARGET = test_parser
+
+SOURCES += main.cpp \
+    ../../src/MusicPlayerClient.cpp \
+    ../../src/CommandMetrics.cpp \
+    ../../src/ProtocolTrace.cpp \
+    ../../src/PlaylistFile.cpp \
+    ../../src/StreamProbe.cpp \
+    ../../src/MemoryReader.cpp \
+    ../../src/pathcat.cpp \
+    ../../src/webclient.cpp
+
+HEADERS += ../../src/MusicPlayerClient.h \
+    ../../src/CommandMetrics.h \
+    ../../src/ProtocolTrace.h \
+    ../../src/PlaylistFile.h \
+    ../../src/StreamProbe.h \
+    ../../src/MemoryReader.h \
+    ../../src/pathcat.h \
+    ../../src/webclient.h
+
+!contains(DEFINES, USE_OPENSSL=0) {
+	unix:LIBS += -lssl -lcrypto
+	win32:LIBS += -llibssl -llibcrypto
+}
+!contains(DEFINES, USE_ZLIB=0) {
+	unix:LIBS += -lz
+	win32:LIBS += -lzlib
+}
@@ -0,0 +1,116 @@
+// StreamProbe の判定。HTTP の応答を直接 StreamProbeHandler に渡すものと、
+// ローカルに立てたサーバに対して StreamProbe::probe を呼ぶものを確かめる
+
+#include "TestCheck.h"
+#include "ParserHarness.h"
+#include "StreamProbe.h"
+
+#include <QCoreApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+
+namespace {
+
+char const html_body[] = "<!DOCTYPE html>\n<html><head><title>302 Found</title></head><body><a href=\"/stream\">moved</a></body></html>\n";
+
+QByteArray mpeg_frames()
+{
+	return QByteArray("\xff\xfb\x90\x64", 4).repeated(256); // MPEG オーディオのフレーム同期
+}
+
+// HEAD は断り、Range 付きの GET に進ませる。/moved は HTML の本文付きで /stream へ 302 を返す
+QByteArray respond(QByteArray const &request)
+{
+	QByteArray line = request.left(request.indexOf("\r\n"));
+	QByteArray head;
+	QByteArray body;
+	if (line.startsWith("HEAD ")) {
+		head = "HTTP/1.1 405 Method Not Allowed\r\n";
+	} else if (line.startsWith("GET /moved ")) {
+		head = "HTTP/1.1 302 Found\r\nLocation: /stream\r\nContent-Type: text/html\r\n";
+		body = html_body;
+	} else if (line.startsWith("GET /stream ")) {
+		head = "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n";
+		body = mpeg_frames();
+	} else {
+		head = "HTTP/1.1 404 Not Found\r\n";
+	}
+	return head + "Content-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+}
+
+// 1 接続ずつ順に応答する
+void serve(std::promise<quint16> *ready, std::atomic<bool> const *quit)
+{
+	QTcpServer server;
+	server.listen(QHostAddress::LocalHost, 0);
+	ready->set_value(server.serverPort());
+	while (!*quit) {
+		if (!server.waitForNewConnection(100)) continue;
+		QTcpSocket *sock = server.nextPendingConnection();
+		QByteArray request;
+		while (!request.contains("\r\n\r\n") && sock->waitForReadyRead(1000)) {
+			request += sock->readAll();
+		}
+		sock->write(respond(request));
+		sock->waitForBytesWritten(1000);
+		sock->disconnectFromHost();
+		if (sock->state() != QAbstractSocket::UnconnectedState) {
+			sock->waitForDisconnected(1000);
+		}
+		delete sock;
+	}
+}
+
+// 3xx の本文は判定に使わず、打ち切りもしない
+void test_redirect_body()
+{
+	std::string response = "HTTP/1.1 302 Found\r\nLocation: http://example.com/stream\r\nContent-Type: text/html\r\n";
+	response += "Content-Length: " + std::to_string(sizeof(html_body) - 1) + "\r\n\r\n";
+	response += html_body;
+	WebClient wc(nullptr);
+	StreamProbeHandler handler(true, 4096);
+	bool aborted = false;
+	try {
+		ParserHarness::httpBegin(&wc);
+		ParserHarness::httpReceive(&wc, response.c_str(), response.size(), &handler);
+	} catch (WebClient::Error const &) {
+		aborted = true;
+	}
+	handler.finish();
+	CHECK(!aborted);
+	CHECK(handler.code == 302);
+	CHECK(handler.kind == StreamProbe::Kind::Unknown);
+	CHECK(handler.total == 0);
+}
+
+// HTML の本文付きの 302 をたどって、その先の音声をストリームと判定する
+void test_probe_redirect()
+{
+	std::promise<quint16> ready;
+	std::atomic<bool> quit(false);
+	std::thread th(serve, &ready, &quit);
+	quint16 port = ready.get_future().get();
+	CHECK(port != 0);
+
+	WebContext webcx;
+	StreamProbe::Result r = StreamProbe::probe(&webcx, QString("http://127.0.0.1:%1/moved").arg(port), nullptr, 5000);
+	CHECK(r.code == 206);
+	CHECK(r.kind == StreamProbe::Kind::Stream);
+
+	quit = true;
+	th.join();
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	QCoreApplication app(argc, argv);
+	test_redirect_body();
+	test_probe_redirect();
+	return testResult();
+}
@@ -0,0 +1,18 @@
+# テスト用ターゲットの共通設定
+
+QT       += core network
+QT       -= gui
+
+TEMPLATE = app
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DESTDIR = $$PWD/../_bin/tests
+
+unix:QMAKE_CXXFLAGS += -Wall -Wextra -Werror=return-type -Werror=trigraphs -Wno-switch -g
+
+INCLUDEPATH += $$PWD $$PWD/../bench $$PWD/../src
+
+HEADERS += $$PWD/TestCheck.h \
+    $$PWD/../bench/ParserHarness.h
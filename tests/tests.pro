@@ -0,0 +1,6 @@
+# 実際に動かして結果を確かめるテスト。それぞれ失敗があれば 0 以外で終わる
+#   qmake -r tests.pro && make && ../_bin/tests/test_probe
+TEMPLATE = subdirs
+
+SUBDIRS = probe \
+    parser